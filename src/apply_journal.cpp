@@ -0,0 +1,300 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "apply_journal.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>      // for upper_bound, find_if
+#include <chrono>         // for system_clock
+#include <cstdlib>        // for getenv
+#include <cstring>        // for memcpy
+#include <filesystem>     // for path, create_directories
+#include <unordered_map>  // for unordered_map
+
+#include <fcntl.h>     // for open
+#include <sys/mman.h>  // for mmap, munmap
+#include <sys/stat.h>  // for fstat
+#include <unistd.h>    // for write, close, ftruncate
+
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Record layout, all fields in host byte order:
+//   RecordHeader
+//   change_count * { uint32 raw_len, uint32 old_len, uint32 new_len, raw, old, new }
+//   padding up to RECORD_ALIGN
+constexpr std::uint32_t RECORD_MAGIC = 0x314a4d53;  // "SMJ1"
+constexpr std::size_t RECORD_ALIGN   = 8;
+
+struct RecordHeader {
+    std::uint32_t magic{};
+    // Including header and padding.
+    std::uint32_t size{};
+    // Of everything after the header.
+    std::uint32_t checksum{};
+    std::uint32_t change_count{};
+    std::int64_t timestamp{};
+};
+constexpr std::size_t ENTRY_HEADER_SIZE = 3 * sizeof(std::uint32_t);
+
+// FNV-1a, enough to tell a torn write.
+constexpr auto checksum_of(std::string_view data) noexcept -> std::uint32_t {
+    std::uint32_t hash = 2166136261U;
+    for (const char ch : data) {
+        hash ^= static_cast<std::uint8_t>(ch);
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+template <typename T>
+inline void append_pod(std::string& buffer, const T& value) noexcept {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));  // NOLINT
+}
+
+template <typename T>
+inline auto read_pod(const char* data) noexcept -> T {
+    T value{};
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+// Returns size of the record at `offset`, or 0 if it's incomplete or corrupted.
+auto validate_record(std::string_view journal, std::size_t offset) noexcept -> std::size_t {
+    if (journal.size() - offset < sizeof(RecordHeader)) {
+        return 0;
+    }
+    const auto header = read_pod<RecordHeader>(journal.data() + offset);
+    if (header.magic != RECORD_MAGIC || header.size < sizeof(RecordHeader) || header.size > journal.size() - offset) {
+        return 0;
+    }
+    const auto payload = journal.substr(offset + sizeof(RecordHeader), header.size - sizeof(RecordHeader));
+    return (checksum_of(payload) == header.checksum) ? header.size : 0;
+}
+
+}  // namespace
+
+ApplyJournal::~ApplyJournal() noexcept {
+    if (m_map != nullptr) {
+        ::munmap(const_cast<char*>(m_map), m_map_size);  // NOLINT
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+std::string ApplyJournal::default_path() noexcept {
+    fs::path state_dir{};
+    if (const char* xdg_state = std::getenv("XDG_STATE_HOME"); xdg_state != nullptr && xdg_state[0] != '\0') {
+        state_dir = xdg_state;
+    } else if (const char* home = std::getenv("HOME"); home != nullptr) {
+        state_dir = fs::path{home} / ".local/state";
+    } else {
+        state_dir = "/tmp";
+    }
+    return (state_dir / "cachyos-sysctl-manager" / "apply.journal").string();
+}
+
+bool ApplyJournal::open(std::string_view journal_path) noexcept {
+    const fs::path file_path{journal_path};
+    std::error_code err{};
+    fs::create_directories(file_path.parent_path(), err);
+
+    m_fd = ::open(file_path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        fmt::print(stderr, "Failed to open journal := '{}'\n", file_path.string());
+        return false;
+    }
+
+    // Drop record torn by a crash in the middle of append,
+    // so new records are not appended after it.
+    refresh();
+    if (m_indexed_size < m_map_size) {
+        fmt::print(stderr, "Dropping {} bytes of incomplete journal record\n", m_map_size - m_indexed_size);
+        if (::ftruncate(m_fd, static_cast<off_t>(m_indexed_size)) != 0) {
+            fmt::print(stderr, "Failed to truncate journal := '{}'\n", file_path.string());
+        }
+    }
+    return true;
+}
+
+bool ApplyJournal::append(std::span<const ApplyChange> changes, std::span<const ApplyResult> results) noexcept {
+    /* clang-format off */
+    if (m_fd < 0) { return false; }
+    /* clang-format on */
+
+    // Readers only map the file, they don't touch anything used here.
+    const std::lock_guard<std::mutex> guard(m_append_mutex);
+    auto& buffer = m_write_buffer;
+    buffer.assign(sizeof(RecordHeader), '\0');
+
+    RecordHeader header{};
+    for (std::size_t i = 0; i < changes.size() && i < results.size(); ++i) {
+        const auto& change = changes[i];
+        const auto& result = results[i];
+        if (result.status != ApplyStatus::Applied && result.status != ApplyStatus::Clamped) {
+            continue;
+        }
+
+        // Kernel might have stored a different value, than requested.
+        append_pod(buffer, static_cast<std::uint32_t>(change.raw.size()));
+        append_pod(buffer, static_cast<std::uint32_t>(change.old_value.size()));
+        append_pod(buffer, static_cast<std::uint32_t>(result.actual.size()));
+        buffer += change.raw;
+        buffer += change.old_value;
+        buffer += result.actual;
+        ++header.change_count;
+    }
+    /* clang-format off */
+    if (header.change_count == 0) { return true; }
+    /* clang-format on */
+
+    buffer.append((RECORD_ALIGN - buffer.size() % RECORD_ALIGN) % RECORD_ALIGN, '\0');
+
+    header.magic     = RECORD_MAGIC;
+    header.size      = static_cast<std::uint32_t>(buffer.size());
+    header.checksum  = checksum_of(std::string_view{buffer}.substr(sizeof(RecordHeader)));
+    header.timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::memcpy(buffer.data(), &header, sizeof(RecordHeader));
+
+    // Single write with O_APPEND, record is never interleaved with another one.
+    const auto bytes_written = ::write(m_fd, buffer.data(), buffer.size());
+    if (bytes_written != static_cast<ssize_t>(buffer.size())) {
+        fmt::print(stderr, "Failed to append journal record\n");
+        return false;
+    }
+    return true;
+}
+
+void ApplyJournal::refresh() noexcept {
+    struct stat file_stat {};
+    if (m_fd < 0 || ::fstat(m_fd, &file_stat) != 0) {
+        return;
+    }
+    const auto file_size = static_cast<std::size_t>(file_stat.st_size);
+    /* clang-format off */
+    if (file_size == m_map_size) { return; }
+    /* clang-format on */
+
+    if (m_map != nullptr) {
+        ::munmap(const_cast<char*>(m_map), m_map_size);  // NOLINT
+        m_map      = nullptr;
+        m_map_size = 0;
+    }
+    if (file_size < m_indexed_size) {
+        // Truncated by someone else, index it from scratch.
+        m_records.clear();
+        m_indexed_size = 0;
+    }
+    /* clang-format off */
+    if (file_size == 0) { return; }
+    /* clang-format on */
+
+    auto* map = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        fmt::print(stderr, "Failed to map journal\n");
+        return;
+    }
+    m_map      = static_cast<const char*>(map);
+    m_map_size = file_size;
+
+    // Index only records appended since last time.
+    const std::string_view journal{m_map, m_map_size};
+    while (const auto record_size = validate_record(journal, m_indexed_size)) {
+        const auto header = read_pod<RecordHeader>(m_map + m_indexed_size);
+        m_records.emplace_back(Record{.timestamp = header.timestamp, .change_count = header.change_count, .offset = m_indexed_size});
+        m_indexed_size += record_size;
+    }
+}
+
+std::span<const ApplyJournal::Record> ApplyJournal::get_records() noexcept {
+    refresh();
+    return m_records;
+}
+
+std::vector<ApplyJournal::Entry> ApplyJournal::get_entries(const Record& record) noexcept {
+    std::vector<Entry> entries;
+    entries.reserve(record.change_count);
+
+    const auto header = read_pod<RecordHeader>(m_map + record.offset);
+    const std::string_view payload{m_map + record.offset + sizeof(RecordHeader), header.size - sizeof(RecordHeader)};
+
+    std::size_t pos{};
+    for (std::uint32_t i = 0; i < record.change_count && payload.size() - pos >= ENTRY_HEADER_SIZE; ++i) {
+        const auto raw_len = read_pod<std::uint32_t>(payload.data() + pos);
+        const auto old_len = read_pod<std::uint32_t>(payload.data() + pos + sizeof(std::uint32_t));
+        const auto new_len = read_pod<std::uint32_t>(payload.data() + pos + 2 * sizeof(std::uint32_t));
+        pos += ENTRY_HEADER_SIZE;
+        /* clang-format off */
+        if (payload.size() - pos < std::size_t{raw_len} + old_len + new_len) { break; }
+        /* clang-format on */
+
+        entries.emplace_back(Entry{
+            .raw       = payload.substr(pos, raw_len),
+            .old_value = payload.substr(pos + raw_len, old_len),
+            .new_value = payload.substr(pos + raw_len + old_len, new_len)});
+        pos += std::size_t{raw_len} + old_len + new_len;
+    }
+    return entries;
+}
+
+std::vector<ApplyChange> ApplyJournal::revert_records(std::span<const Record> records) noexcept {
+    std::vector<ApplyChange> changes;
+    std::unordered_map<std::string_view, std::size_t> change_indices{};
+
+    // Newest record goes first: it has the current value of the key,
+    // while the oldest one has the value to revert to.
+    for (auto it = records.rbegin(); it != records.rend(); ++it) {
+        for (auto&& entry : get_entries(*it)) {
+            if (auto found = change_indices.find(entry.raw); found != change_indices.end()) {
+                changes[found->second].new_value = entry.old_value;
+                continue;
+            }
+
+            std::string option_name{entry.raw};
+            SysctlOption::normalize_name(option_name);
+            change_indices.emplace(entry.raw, changes.size());
+            changes.emplace_back(ApplyChange{
+                .raw       = std::string{entry.raw},
+                .name      = std::move(option_name),
+                .old_value = std::string{entry.new_value},
+                .new_value = std::string{entry.old_value}});
+        }
+    }
+
+    // Keys which were changed back and forth, are already at the target value.
+    std::erase_if(changes, [](auto&& change) { return ApplyTransaction::values_equal(change.old_value, change.new_value); });
+    return changes;
+}
+
+std::vector<ApplyChange> ApplyJournal::revert_last(std::size_t count) noexcept {
+    const auto records = get_records();
+    return revert_records(records.last(std::min(count, records.size())));
+}
+
+std::vector<ApplyChange> ApplyJournal::revert_to(std::int64_t timestamp) noexcept {
+    const auto records = get_records();
+    // Records are appended in time order, unless the clock was set back.
+    const auto first_after = std::upper_bound(records.begin(), records.end(), timestamp,
+        [](std::int64_t lhs, auto&& record) { return lhs < record.timestamp; });
+    return revert_records({first_after, records.end()});
+}
@@ -0,0 +1,106 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef APPLY_JOURNAL_HPP
+#define APPLY_JOURNAL_HPP
+
+#include "apply_transaction.hpp"
+
+#include <cstdint>      // for int64_t, uint32_t
+#include <mutex>        // for mutex
+#include <span>         // for span
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+// Append-only journal of applied change sets.
+//
+// Every apply is stored as one binary record (timestamp, and key, old and new value
+// of every changed option), appended with a single `write`. Journal is read
+// through `mmap`, with an in-memory index of record offsets. Reverts are computed
+// from the journal alone, without rescanning options.
+class ApplyJournal final {
+ public:
+    struct Record {
+        // Seconds since epoch.
+        std::int64_t timestamp{};
+        std::uint32_t change_count{};
+        // Offset of the record in the journal.
+        std::size_t offset{};
+    };
+
+    // Points into the mapped journal, valid until next call to non-const method.
+    struct Entry {
+        std::string_view raw{};
+        std::string_view old_value{};
+        std::string_view new_value{};
+    };
+
+    ApplyJournal() = default;
+    ~ApplyJournal() noexcept;
+
+    ApplyJournal(const ApplyJournal&)            = delete;
+    ApplyJournal& operator=(const ApplyJournal&) = delete;
+
+    // Opens journal, creating it if it doesn't exist.
+    bool open(std::string_view journal_path) noexcept;
+
+    /* clang-format off */
+    inline bool is_open() const noexcept
+    { return m_fd >= 0; }
+    /* clang-format on */
+
+    // Stores options which were changed by the transaction (applied or clamped),
+    // `results` are in the order of transaction changes.
+    // Can be called from a worker thread, while the journal is read elsewhere.
+    bool append(std::span<const ApplyChange> changes, std::span<const ApplyResult> results) noexcept;
+
+    // Records in order of appending, oldest first.
+    std::span<const Record> get_records() noexcept;
+
+    std::vector<Entry> get_entries(const Record& record) noexcept;
+
+    // Changes which undo last `count` applies.
+    // Old value of the change is the value left by the newest of them.
+    std::vector<ApplyChange> revert_last(std::size_t count) noexcept;
+
+    // Changes which undo all applies made after `timestamp`.
+    std::vector<ApplyChange> revert_to(std::int64_t timestamp) noexcept;
+
+    // Journal path under XDG state directory.
+    static std::string default_path() noexcept;
+
+ private:
+    // Maps the whole journal again if it grew, and indexes new records.
+    void refresh() noexcept;
+    std::vector<ApplyChange> revert_records(std::span<const Record> records) noexcept;
+
+    int m_fd{-1};
+    const char* m_map{};
+    std::size_t m_map_size{};
+    // End of the last complete record, torn record at the end is ignored.
+    std::size_t m_indexed_size{};
+    std::vector<Record> m_records{};
+    // Appends may come from a worker thread.
+    std::mutex m_append_mutex{};
+    // Reused between appends.
+    std::string m_write_buffer{};
+};
+
+#endif  // APPLY_JOURNAL_HPP
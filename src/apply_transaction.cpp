@@ -0,0 +1,204 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "apply_transaction.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>  // for min, any_of
+#include <cstdio>     // for stderr
+#include <future>     // for async, future
+#include <thread>     // for thread
+
+#include <fmt/core.h>
+
+namespace {
+
+// Minimal amount of keys read back by one thread.
+// Reading a single proc file is cheap, spawning a thread is not.
+constexpr std::size_t MIN_KEYS_PER_THREAD = 16;
+
+auto shell_quote(std::string_view value) noexcept -> std::string {
+    std::string quoted{"'"};
+    for (auto&& ch : value) {
+        if (ch == '\'') {
+            quoted += R"('\'')";
+            continue;
+        }
+        quoted += ch;
+    }
+    quoted += '\'';
+    return quoted;
+}
+
+auto make_write_cmd(std::string_view raw, std::string_view value) noexcept -> std::string {
+    return fmt::format("echo {} > {}", shell_quote(value), shell_quote(fmt::format("{}{}", SysctlOption::PROC_PATH, raw)));
+}
+
+// Reads back current values of `changes`, spreading work over available cores.
+// `on_value` is called with the index of the change and its value, from several threads.
+template <typename Func>
+void parallel_read_back(std::span<const ApplyChange> changes, Func&& on_value) noexcept {
+    const auto hw_threads  = std::max(std::thread::hardware_concurrency(), 1U);
+    const auto max_threads = (changes.size() + MIN_KEYS_PER_THREAD - 1) / MIN_KEYS_PER_THREAD;
+    const auto threads     = std::min<std::size_t>(hw_threads, max_threads);
+    if (threads <= 1) {
+        for (std::size_t i = 0; i < changes.size(); ++i) {
+            on_value(i, SysctlOption::read_value(changes[i].raw));
+        }
+        return;
+    }
+
+    const auto chunk_size = (changes.size() + threads - 1) / threads;
+    std::vector<std::future<void>> tasks{};
+    tasks.reserve(threads);
+    for (std::size_t begin = 0; begin < changes.size(); begin += chunk_size) {
+        const auto end = std::min(begin + chunk_size, changes.size());
+        tasks.emplace_back(std::async(std::launch::async, [&changes, &on_value, begin, end] {
+            for (std::size_t i = begin; i < end; ++i) {
+                on_value(i, SysctlOption::read_value(changes[i].raw));
+            }
+        }));
+    }
+    for (auto&& task : tasks) {
+        task.wait();
+    }
+}
+
+}  // namespace
+
+bool ApplyTransaction::values_equal(std::string_view lhs, std::string_view rhs) noexcept {
+    constexpr std::string_view whitespace = " \t\n";
+
+    while (true) {
+        lhs.remove_prefix(std::min(lhs.find_first_not_of(whitespace), lhs.size()));
+        rhs.remove_prefix(std::min(rhs.find_first_not_of(whitespace), rhs.size()));
+        if (lhs.empty() || rhs.empty()) {
+            return lhs.empty() && rhs.empty();
+        }
+
+        const auto lhs_token = lhs.substr(0, lhs.find_first_of(whitespace));
+        const auto rhs_token = rhs.substr(0, rhs.find_first_of(whitespace));
+        if (lhs_token != rhs_token) {
+            return false;
+        }
+        lhs.remove_prefix(lhs_token.size());
+        rhs.remove_prefix(rhs_token.size());
+    }
+}
+
+ApplyTransaction::ApplyTransaction(std::vector<ApplyChange>&& changes) noexcept
+  : m_changes(std::move(changes)) {
+    // Paths come from user input or the journal file, while the script is run as root.
+    std::erase_if(m_changes, [this](auto&& change) {
+        if (SysctlOption::is_option_path(change.raw)) {
+            return false;
+        }
+        fmt::print(stderr, "Not an option path := '{}'\n", change.raw);
+        m_rejected.emplace_back(ApplyResult{.name = change.name, .requested = change.new_value, .status = ApplyStatus::Failed});
+        return true;
+    });
+
+    // Snapshot only the few changed keys, scanned values might be outdated by now.
+    for (auto&& change : m_changes) {
+        if (auto current_value = SysctlOption::read_value(change.raw); current_value) {
+            change.old_value = std::move(*current_value);
+        }
+    }
+}
+
+std::string ApplyTransaction::generate_apply_script() const noexcept {
+    std::string bash_script;
+
+    for (auto&& change : m_changes) {
+        bash_script += make_write_cmd(change.raw, change.new_value);
+        bash_script += " && ";
+    }
+
+    // Remove last occurencies of ' && '
+    if (bash_script.ends_with(" && ")) {
+        bash_script.erase(bash_script.size() - 4);
+    }
+    return bash_script;
+}
+
+std::vector<ApplyResult> ApplyTransaction::verify() const noexcept {
+    std::vector<ApplyResult> results(m_changes.size());
+
+    // Each task writes only into its own slots, no locking required.
+    parallel_read_back(m_changes, [this, &results](std::size_t index, auto&& actual_value) {
+        const auto& change = m_changes[index];
+        auto& result       = results[index];
+
+        result.name      = change.name;
+        result.requested = change.new_value;
+        if (!actual_value) {
+            result.status = ApplyStatus::Failed;
+            return;
+        }
+        result.actual = std::move(*actual_value);
+
+        if (values_equal(result.actual, change.new_value)) {
+            result.status = ApplyStatus::Applied;
+        } else if (values_equal(result.actual, change.old_value)) {
+            result.status = ApplyStatus::Failed;
+        } else {
+            result.status = ApplyStatus::Clamped;
+        }
+    });
+    return results;
+}
+
+std::string ApplyTransaction::generate_rollback_script(std::span<const ApplyResult> results) const noexcept {
+    const bool has_failed = std::any_of(results.begin(), results.end(),
+        [](auto&& result) { return result.status == ApplyStatus::Failed; });
+    if (!has_failed) {
+        return {};
+    }
+
+    std::string bash_script;
+    for (std::size_t i = 0; i < m_changes.size() && i < results.size(); ++i) {
+        const auto& change = m_changes[i];
+        const auto& result = results[i];
+        if (result.status == ApplyStatus::Failed || values_equal(result.actual, change.old_value)) {
+            continue;
+        }
+
+        // Try to restore every key, even if one of them fails.
+        bash_script += make_write_cmd(change.raw, change.old_value);
+        bash_script += "; ";
+    }
+
+    // Remove last occurencies of '; '
+    if (bash_script.ends_with("; ")) {
+        bash_script.erase(bash_script.size() - 2);
+    }
+    return bash_script;
+}
+
+void ApplyTransaction::verify_rollback(std::vector<ApplyResult>& results) const noexcept {
+    parallel_read_back(m_changes, [this, &results](std::size_t index, auto&& actual_value) {
+        auto& result = results[index];
+        if (!actual_value || result.status == ApplyStatus::Failed) {
+            return;
+        }
+        result.actual = std::move(*actual_value);
+        if (values_equal(result.actual, m_changes[index].old_value)) {
+            result.status = ApplyStatus::RolledBack;
+        }
+    });
+}
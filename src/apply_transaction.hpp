@@ -0,0 +1,115 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef APPLY_TRANSACTION_HPP
+#define APPLY_TRANSACTION_HPP
+
+#include <cstdint>      // for uint8_t
+#include <span>         // for span
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+struct ApplyChange {
+    // Option path relative to SysctlOption::PROC_PATH.
+    std::string raw{};
+    std::string name{};
+    std::string old_value{};
+    std::string new_value{};
+};
+
+enum class ApplyStatus : std::uint8_t {
+    Applied,
+    // Kernel accepted the write, but stored a different value.
+    Clamped,
+    // Value was not written, or could not be read back.
+    Failed,
+    RolledBack,
+};
+
+struct ApplyResult {
+    std::string name{};
+    std::string requested{};
+    std::string actual{};
+    ApplyStatus status{ApplyStatus::Failed};
+};
+
+// Applies a set of changes as a single unit.
+//
+// Old values of the changed keys are read from the kernel on construction, so rollback
+// restores what was there right before the apply, not a value from an older scan.
+// All writes are executed in one batch, and only the changed keys are read back afterwards.
+// If any write failed, the keys changed before it are restored.
+class ApplyTransaction {
+ public:
+    // Old values passed by caller are kept only for keys, which cannot be read.
+    // Changes with paths, which don't name an option under PROC_PATH, are never written,
+    // they are reported as failed by `execute`.
+    explicit ApplyTransaction(std::vector<ApplyChange>&& changes) noexcept;
+
+    /* clang-format off */
+    inline bool empty() const noexcept
+    { return m_changes.empty() && m_rejected.empty(); }
+
+    inline std::span<const ApplyChange> get_changes() const noexcept
+    { return m_changes; }
+    /* clang-format on */
+
+    // Generates script, which writes all new values.
+    // Stops at first failed write.
+    std::string generate_apply_script() const noexcept;
+
+    // Reads back current values of the changed keys concurrently,
+    // and compares them with the requested ones.
+    std::vector<ApplyResult> verify() const noexcept;
+
+    // Generates script, which restores old values of keys changed by the apply.
+    // Returns empty string, if the transaction doesn't need to be rolled back.
+    std::string generate_rollback_script(std::span<const ApplyResult> results) const noexcept;
+
+    // Reads back values after rollback, and marks restored keys as rolled back.
+    void verify_rollback(std::vector<ApplyResult>& results) const noexcept;
+
+    // Runs apply script with `run_script`, reads back the values,
+    // and runs rollback script if any write failed.
+    // Results of rejected changes come last, they don't cause the rollback.
+    template <typename Func>
+    std::vector<ApplyResult> execute(Func&& run_script) const noexcept {
+        if (!m_changes.empty()) {
+            run_script(generate_apply_script());
+        }
+
+        // Read back only changed options, instead of rescanning whole tree.
+        auto results = verify();
+        if (const auto& rollback_script = generate_rollback_script(results); !rollback_script.empty()) {
+            run_script(rollback_script);
+            verify_rollback(results);
+        }
+        results.insert(results.end(), m_rejected.begin(), m_rejected.end());
+        return results;
+    }
+
+    // Compares two values, ignoring differences in whitespace.
+    static bool values_equal(std::string_view lhs, std::string_view rhs) noexcept;
+
+ private:
+    std::vector<ApplyChange> m_changes{};
+    std::vector<ApplyResult> m_rejected{};
+};
+
+#endif  // APPLY_TRANSACTION_HPP
@@ -0,0 +1,182 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "drift_enforcer.hpp"
+#include "prom_exporter.hpp"
+#include "scan_rules.hpp"
+
+#include <atomic>        // for atomic
+#include <charconv>      // for from_chars
+#include <csignal>       // for sigaction, SIGINT, SIGTERM
+#include <cstdint>       // for uint32_t
+#include <optional>      // for optional
+#include <string>        // for string
+#include <string_view>   // for string_view
+#include <system_error>  // for errc
+#include <thread>        // for jthread
+
+#include <getopt.h>   // for getopt_long
+#include <pthread.h>  // for pthread_sigmask
+
+#include <fmt/core.h>
+
+namespace {
+
+std::atomic<bool> g_stop_requested{};
+
+void on_stop_signal(int) noexcept {
+    g_stop_requested.store(true, std::memory_order_relaxed);
+}
+
+void print_usage(std::string_view program_name) noexcept {
+    fmt::print(stderr,
+        "Usage: {} [options] [<profile>]\n"
+        "Keeps sysctl options at values from <profile> (sysctl.conf syntax),\n"
+        "and/or exports numeric options into Prometheus textfile.\n\n"
+        "Options:\n"
+        "  --min-interval <sec>     Check interval after a drift (default {}).\n"
+        "  --max-interval <sec>     Check interval of stable options (default {}).\n"
+        "  --export <file>          Write numeric options into <file> (e.g node.prom).\n"
+        "  --export-interval <sec>  Interval of export (default {}).\n"
+        "  --scope <prefix>         Export only options under <prefix>. Can be repeated.\n"
+        "  --exclude <prefix>       Don't export options under <prefix>. Can be repeated.\n"
+        "  -h, --help               Displays help.\n",
+        program_name, DriftEnforcer::DEFAULT_MIN_INTERVAL_SEC, DriftEnforcer::DEFAULT_MAX_INTERVAL_SEC, PromExporter::DEFAULT_INTERVAL_SEC);
+}
+
+bool parse_seconds(std::string_view arg, std::uint32_t& out) noexcept {
+    const auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), out);
+    return ec == std::errc{} && ptr == arg.data() + arg.size() && out > 0;
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> std::int32_t {
+    enum : int { MIN_INTERVAL = 256,
+        MAX_INTERVAL,
+        EXPORT,
+        EXPORT_INTERVAL,
+        SCOPE,
+        EXCLUDE };
+    static constexpr option long_options[] = {
+        {"min-interval", required_argument, nullptr, MIN_INTERVAL},
+        {"max-interval", required_argument, nullptr, MAX_INTERVAL},
+        {"export", required_argument, nullptr, EXPORT},
+        {"export-interval", required_argument, nullptr, EXPORT_INTERVAL},
+        {"scope", required_argument, nullptr, SCOPE},
+        {"exclude", required_argument, nullptr, EXCLUDE},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    std::uint32_t min_interval_sec    = DriftEnforcer::DEFAULT_MIN_INTERVAL_SEC;
+    std::uint32_t max_interval_sec    = DriftEnforcer::DEFAULT_MAX_INTERVAL_SEC;
+    std::uint32_t export_interval_sec = PromExporter::DEFAULT_INTERVAL_SEC;
+    std::string export_path{};
+    auto export_rules = ScanRules::default_rules();
+
+    int opt{};
+    while ((opt = ::getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case MIN_INTERVAL:
+        case MAX_INTERVAL:
+        case EXPORT_INTERVAL: {
+            auto& interval_sec = (opt == MIN_INTERVAL) ? min_interval_sec : ((opt == MAX_INTERVAL) ? max_interval_sec : export_interval_sec);
+            if (!parse_seconds(optarg, interval_sec)) {
+                fmt::print(stderr, "Invalid interval := '{}'\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case EXPORT:
+            export_path = optarg;
+            break;
+        case SCOPE:
+            export_rules.add_include(optarg);
+            break;
+        case EXCLUDE:
+            export_rules.add_exclude(optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    const bool has_profile = (optind + 1 == argc);
+    if (optind + 1 < argc || (!has_profile && export_path.empty())) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::optional<DriftEnforcer> enforcer{};
+    if (has_profile) {
+        enforcer.emplace(min_interval_sec, max_interval_sec);
+        if (!enforcer->load_profile(argv[optind])) {
+            return 1;
+        }
+        if (enforcer->get_key_count() == 0) {
+            fmt::print(stderr, "Nothing to enforce in := '{}'\n", argv[optind]);
+            return 1;
+        }
+        fmt::print("Enforcing {} options from '{}'\n", enforcer->get_key_count(), argv[optind]);
+    }
+
+    std::optional<PromExporter> exporter{};
+    if (!export_path.empty()) {
+        exporter.emplace(export_path, export_interval_sec);
+        if (!exporter->select_options(export_rules)) {
+            fmt::print(stderr, "No numeric options to export\n");
+            return 1;
+        }
+        fmt::print("Exporting {} options into '{}'\n", exporter->get_metric_count(), export_path);
+    }
+
+    // No SA_RESTART, so the signal wakes up the sleeping loop.
+    struct sigaction stop_action {};
+    stop_action.sa_handler = on_stop_signal;
+    ::sigemptyset(&stop_action.sa_mask);
+    ::sigaction(SIGINT, &stop_action, nullptr);
+    ::sigaction(SIGTERM, &stop_action, nullptr);
+
+    if (!enforcer) {
+        exporter->run(g_stop_requested);
+        return 0;
+    }
+
+    std::jthread exporter_thread{};
+    if (exporter) {
+        // Stop signals go to the enforcer thread, so its sleep is interrupted.
+        // Exporter notices stop request on its next refresh.
+        sigset_t stop_signals{};
+        ::sigemptyset(&stop_signals);
+        ::sigaddset(&stop_signals, SIGINT);
+        ::sigaddset(&stop_signals, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+        exporter_thread = std::jthread([&exporter] { exporter->run(g_stop_requested); });
+        ::pthread_sigmask(SIG_UNBLOCK, &stop_signals, nullptr);
+    }
+
+    enforcer->run(g_stop_requested);
+
+    fmt::print("Stopped, {} corrections made\n", enforcer->get_correction_count());
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "drift_enforcer.hpp"
+#include "apply_transaction.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>      // for min, push_heap, pop_heap
+#include <cerrno>         // for errno, EACCES, EPERM
+#include <cstdio>         // for fflush
+#include <fstream>        // for ifstream
+#include <functional>     // for greater
+#include <unordered_map>  // for unordered_map
+
+#include <fcntl.h>  // for O_RDWR
+
+#include <fmt/core.h>
+
+namespace {
+
+// Keys due that close to each other are checked in one wakeup.
+constexpr std::int64_t BATCH_SLACK_NS = polling::NSEC_PER_SEC / 20;
+
+constexpr auto trim_value(std::string_view value) noexcept -> std::string_view {
+    const auto last = value.find_last_not_of(" \t\n");
+    return (last == std::string_view::npos) ? std::string_view{} : value.substr(0, last + 1);
+}
+
+}  // namespace
+
+DriftEnforcer::DriftEnforcer(std::uint32_t min_interval_sec, std::uint32_t max_interval_sec) noexcept
+  : m_min_interval_ns(static_cast<std::int64_t>(std::max(min_interval_sec, 1U)) * polling::NSEC_PER_SEC),
+    m_max_interval_ns(static_cast<std::int64_t>(std::max(max_interval_sec, min_interval_sec)) * polling::NSEC_PER_SEC) {
+    m_read_buffer.resize(polling::MAX_VALUE_SIZE);
+}
+
+bool DriftEnforcer::load_profile(std::string_view profile_path) noexcept {
+    std::ifstream profile_file{std::string{profile_path}};
+    if (!profile_file.is_open()) {
+        fmt::print(stderr, "Failed to open profile := '{}'\n", profile_path);
+        return false;
+    }
+
+    // Last occurence of the key wins, like with sysctl.conf.
+    std::unordered_map<std::string, std::uint32_t> key_indices{};
+    std::string line{};
+    while (std::getline(profile_file, line)) {
+        std::string_view key{};
+        std::string_view value{};
+        if (!SysctlOption::parse_conf_line(line, key, value)) {
+            continue;
+        }
+
+        std::string raw_path{key};
+        SysctlOption::normalize_path(raw_path);
+        std::string option_name{raw_path};
+        SysctlOption::normalize_name(option_name);
+
+        if (auto it = key_indices.find(option_name); it != key_indices.end()) {
+            m_keys[it->second].desired = SysctlOption::normalize_value(value);
+            continue;
+        }
+
+        // Write access is needed only for corrections, still watch the option without it.
+        polling::OptionFile file{};
+        bool read_only{};
+        if (!file.open(raw_path, O_RDWR) && (errno == EACCES || errno == EPERM)) {
+            read_only = file.open(raw_path);
+        }
+        if (!file.is_open()) {
+            fmt::print(stderr, "Failed to open := '{}{}'\n", SysctlOption::PROC_PATH, raw_path);
+            continue;
+        }
+        if (read_only) {
+            fmt::print(stderr, "{}: not writable, drift will be only reported\n", option_name);
+        }
+
+        key_indices.emplace(option_name, static_cast<std::uint32_t>(m_keys.size()));
+        m_keys.emplace_back(EnforcedKey{
+            .name        = std::move(option_name),
+            .desired     = SysctlOption::normalize_value(value),
+            .file        = std::move(file),
+            .read_only   = read_only,
+            .interval_ns = m_min_interval_ns});
+    }
+
+    m_schedule.reserve(m_keys.size());
+    m_drifted.reserve(m_keys.size());
+    return true;
+}
+
+auto DriftEnforcer::check_key(EnforcedKey& key) noexcept -> KeyState {
+    const auto actual = key.file.read(m_read_buffer);
+    /* clang-format off */
+    if (!actual) { return KeyState::Unreadable; }
+    /* clang-format on */
+
+    if (ApplyTransaction::values_equal(*actual, key.desired)) {
+        return KeyState::Matches;
+    }
+    key.drifted_value = trim_value(*actual);
+    return KeyState::Drifted;
+}
+
+void DriftEnforcer::schedule(std::uint32_t key_index, std::int64_t deadline) noexcept {
+    m_schedule.emplace_back(deadline, key_index);
+    std::push_heap(m_schedule.begin(), m_schedule.end(), std::greater<>{});
+}
+
+void DriftEnforcer::correct_drifted() noexcept {
+    const auto now = polling::monotonic_now();
+    for (const auto key_index : m_drifted) {
+        auto& key = m_keys[key_index];
+
+        if (key.read_only) {
+            fmt::print("{}: drifted to '{}', expected '{}'\n", key.name, key.drifted_value, key.desired);
+            key.interval_ns = std::min(key.interval_ns * 2, m_max_interval_ns);
+            schedule(key_index, now + key.interval_ns);
+            continue;
+        }
+
+        const auto state = key.file.write(key.desired) ? check_key(key) : KeyState::Drifted;
+        if (state == KeyState::Matches) {
+            fmt::print("{}: drifted to '{}', restored '{}'\n", key.name, key.drifted_value, key.desired);
+            ++m_corrections;
+            // Something keeps changing it, look at it more often.
+            key.interval_ns = m_min_interval_ns;
+        } else if (state == KeyState::Unreadable) {
+            fmt::print(stderr, "{}: failed to read back restored '{}'\n", key.name, key.desired);
+            key.interval_ns = std::min(key.interval_ns * 2, m_max_interval_ns);
+        } else {
+            // Kernel rejects or clamps the value, don't retry it every time.
+            fmt::print(stderr, "{}: failed to restore '{}', kernel has '{}'\n", key.name, key.desired, key.drifted_value);
+            key.interval_ns = std::min(key.interval_ns * 2, m_max_interval_ns);
+        }
+        schedule(key_index, now + key.interval_ns);
+    }
+
+    // Stdout is fully buffered under systemd, don't keep the log of this batch in the buffer.
+    if (!m_drifted.empty()) {
+        std::fflush(stdout);
+    }
+    m_drifted.clear();
+}
+
+void DriftEnforcer::run(const std::atomic<bool>& stop_requested) noexcept {
+    m_schedule.clear();
+    const auto start_time = polling::monotonic_now();
+    for (std::uint32_t i = 0; i < m_keys.size(); ++i) {
+        schedule(i, start_time);
+    }
+
+    while (!stop_requested.load(std::memory_order_relaxed) && !m_schedule.empty()) {
+        const auto now      = polling::monotonic_now();
+        const auto deadline = m_schedule.front().first;
+        if (deadline > now) {
+            // Signal interrupts the sleep, and stop flag is checked again.
+            polling::sleep_until(deadline);
+            continue;
+        }
+
+        // Check all keys due now, or shortly after. Rescheduled ones are due
+        // at least one minimal interval later, so they don't come back in this batch.
+        const auto batch_end = now + BATCH_SLACK_NS;
+        while (!m_schedule.empty() && m_schedule.front().first <= batch_end) {
+            std::pop_heap(m_schedule.begin(), m_schedule.end(), std::greater<>{});
+            const auto key_index = m_schedule.back().second;
+            m_schedule.pop_back();
+
+            auto& key        = m_keys[key_index];
+            const auto state = check_key(key);
+            if (state == KeyState::Drifted) {
+                m_drifted.push_back(key_index);
+                continue;
+            }
+            // Nothing is written to a key, which can't be read.
+            if (state == KeyState::Unreadable && !key.unreadable) {
+                fmt::print(stderr, "{}: failed to read, not enforced until it's readable again\n", key.name);
+            }
+            key.unreadable = (state == KeyState::Unreadable);
+
+            // Stable or unreadable, back off.
+            key.interval_ns = std::min(key.interval_ns * 2, m_max_interval_ns);
+            schedule(key_index, now + key.interval_ns);
+        }
+
+        // Re-apply drifted ones together.
+        correct_drifted();
+    }
+}
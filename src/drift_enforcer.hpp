@@ -0,0 +1,104 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef DRIFT_ENFORCER_HPP
+#define DRIFT_ENFORCER_HPP
+
+#include "polling.hpp"
+
+#include <atomic>       // for atomic
+#include <cstdint>      // for int64_t, uint32_t, uint64_t
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <utility>      // for pair
+#include <vector>       // for vector
+
+// Keeps options at values from the desired-state profile.
+//
+// Profile uses sysctl.conf syntax (`key = value`). Every enforced option
+// is opened once, and checked with `pread` on its own schedule: interval
+// doubles while the value is stable, and drops to the minimum after a drift.
+// Options due within the same wakeup are checked, and re-applied, as one batch.
+class DriftEnforcer final {
+ public:
+    static constexpr std::uint32_t DEFAULT_MIN_INTERVAL_SEC = 1;
+    static constexpr std::uint32_t DEFAULT_MAX_INTERVAL_SEC = 64;
+
+    explicit DriftEnforcer(std::uint32_t min_interval_sec = DEFAULT_MIN_INTERVAL_SEC, std::uint32_t max_interval_sec = DEFAULT_MAX_INTERVAL_SEC) noexcept;
+
+    DriftEnforcer(const DriftEnforcer&)            = delete;
+    DriftEnforcer& operator=(const DriftEnforcer&) = delete;
+
+    // Loads profile, and opens its options. Options which cannot be opened are skipped.
+    // Returns false, if profile cannot be read.
+    bool load_profile(std::string_view profile_path) noexcept;
+
+    /* clang-format off */
+    inline std::size_t get_key_count() const noexcept
+    { return m_keys.size(); }
+
+    inline std::uint64_t get_correction_count() const noexcept
+    { return m_corrections; }
+    /* clang-format on */
+
+    // Enforces profile until `stop_requested` is set.
+    // Sleep is interrupted by signals, so it's fine to set it from a signal handler.
+    void run(const std::atomic<bool>& stop_requested) noexcept;
+
+ private:
+    struct EnforcedKey {
+        std::string name{};
+        std::string desired{};
+        polling::OptionFile file{};
+        // Opened read-only (e.g not running as root), drift is only reported.
+        bool read_only{};
+        std::int64_t interval_ns{};
+        // Value found on the last failed check.
+        std::string drifted_value{};
+        // Last check couldn't read the value, it's reported only once.
+        bool unreadable{};
+    };
+    enum class KeyState : std::uint8_t {
+        Matches,
+        Drifted,
+        // Read failed, e.g interface of the option is gone.
+        Unreadable,
+    };
+    // Deadline (CLOCK_MONOTONIC, nsec) and index into m_keys.
+    using ScheduleEntry = std::pair<std::int64_t, std::uint32_t>;
+
+    // Compares value of the key with the desired one, drifted value is kept in the key.
+    KeyState check_key(EnforcedKey& key) noexcept;
+    void correct_drifted() noexcept;
+    void schedule(std::uint32_t key_index, std::int64_t deadline) noexcept;
+
+    std::int64_t m_min_interval_ns{};
+    std::int64_t m_max_interval_ns{};
+    std::uint64_t m_corrections{};
+
+    std::vector<EnforcedKey> m_keys{};
+    // Min-heap on deadline.
+    std::vector<ScheduleEntry> m_schedule{};
+    // Indices of keys drifted in the current batch.
+    std::vector<std::uint32_t> m_drifted{};
+    // Last read value, reused between reads.
+    std::string m_read_buffer{};
+};
+
+#endif  // DRIFT_ENFORCER_HPP
@@ -0,0 +1,124 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "fleet-diff-window.hpp"
+
+#include <string>  // for string
+#include <vector>  // for vector
+
+#include <QHeaderView>
+#include <QIcon>
+#include <QStatusBar>
+
+namespace {
+
+auto join_hosts(std::span<const std::string> hosts, std::span<const std::uint32_t> host_indices) noexcept -> QString {
+    QStringList host_names;
+    host_names.reserve(static_cast<qsizetype>(host_indices.size()));
+    for (auto&& host : host_indices) {
+        host_names << QString::fromStdString(hosts[host]);
+    }
+    return host_names.join(QStringLiteral(", "));
+}
+
+}  // namespace
+
+FleetDiffWindow::FleetDiffWindow(const QStringList& dump_paths, QWidget* parent)
+  : QMainWindow(parent) {
+    setWindowTitle(tr("CachyOS Sysctl Manager - Fleet diff"));
+    setWindowIcon(QIcon::fromTheme(QStringLiteral("cachyos-sysctl-manager")));
+    resize(887, 544);
+
+    QStringList column_names;
+    column_names << tr("Key")
+                 << tr("Value")
+                 << tr("Hosts")
+                 << tr("Deviation");
+    m_tree_diff->setHeaderLabels(column_names);
+    m_tree_diff->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_tree_diff->setSelectionMode(QAbstractItemView::SingleSelection);
+    setCentralWidget(m_tree_diff);
+
+    statusBar()->showMessage(tr("Loading %1 dumps...").arg(dump_paths.size()));
+
+    std::vector<std::string> paths{};
+    paths.reserve(static_cast<std::size_t>(dump_paths.size()));
+    for (auto&& dump_path : dump_paths) {
+        paths.emplace_back(dump_path.toStdString());
+    }
+
+    m_scheduler.submit(TaskPriority::Normal, [this, paths = std::move(paths)](std::stop_token stoken) {
+        auto&& fleet_diff = FleetDiff::load(paths);
+        /* clang-format off */
+        if (stoken.stop_requested()) { return; }
+        /* clang-format on */
+        QMetaObject::invokeMethod(
+            this, [this, fleet_diff = std::move(fleet_diff)]() mutable { on_fleet_loaded(std::move(fleet_diff)); }, Qt::QueuedConnection);
+    });
+}
+
+FleetDiffWindow::~FleetDiffWindow() {
+    m_scheduler.shutdown();
+}
+
+void FleetDiffWindow::on_fleet_loaded(FleetDiff&& fleet_diff) noexcept {
+    const auto& hosts = fleet_diff.get_hosts();
+
+    QFont outlier_font = m_tree_diff->font();
+    outlier_font.setBold(true);
+
+    for (auto&& key_diff : fleet_diff.get_differences()) {
+        auto* key_item = new QTreeWidgetItem(m_tree_diff);  // NOLINT
+        key_item->setText(FleetCol::Key, QString::fromStdString(key_diff.key));
+
+        std::size_t outlier_count = key_diff.missing.size();
+        for (std::size_t i = 0; i < key_diff.values.size(); ++i) {
+            const auto& group = key_diff.values[i];
+
+            // Majority value is shown on the key row, others are outliers.
+            if (i == 0) {
+                key_item->setText(FleetCol::Value, QString::fromStdString(group.value));
+                continue;
+            }
+            outlier_count += group.hosts.size();
+
+            auto* group_item = new QTreeWidgetItem(key_item);  // NOLINT
+            group_item->setText(FleetCol::Value, QString::fromStdString(group.value));
+            group_item->setText(FleetCol::Hosts, join_hosts(hosts, group.hosts));
+            if (group.deviation) {
+                group_item->setText(FleetCol::Deviation, QString::fromStdString(group.deviation->to_string()));
+            }
+            group_item->setFont(FleetCol::Hosts, outlier_font);
+        }
+
+        if (!key_diff.missing.empty()) {
+            auto* missing_item = new QTreeWidgetItem(key_item);  // NOLINT
+            missing_item->setText(FleetCol::Value, tr("<missing>"));
+            missing_item->setText(FleetCol::Hosts, join_hosts(hosts, key_diff.missing));
+            missing_item->setFont(FleetCol::Hosts, outlier_font);
+        }
+
+        key_item->setText(FleetCol::Hosts, tr("%1 of %2 hosts differ").arg(outlier_count).arg(hosts.size()));
+    }
+
+    statusBar()->showMessage(tr("%1 hosts, %2 keys, %3 differ, %4 dumps failed to load")
+                                 .arg(hosts.size())
+                                 .arg(fleet_diff.get_key_count())
+                                 .arg(fleet_diff.get_differences().size())
+                                 .arg(fleet_diff.get_failed().size()));
+}
@@ -0,0 +1,52 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLEET_DIFF_WINDOW_HPP_
+#define FLEET_DIFF_WINDOW_HPP_
+
+#include "fleet_diff.hpp"
+#include "task_scheduler.hpp"
+
+#include <QMainWindow>
+#include <QStringList>
+#include <QTreeWidget>
+
+namespace FleetCol {
+enum { Key,
+    Value,
+    Hosts,
+    Deviation };
+}
+
+// Shows keys, which differ across sysctl dumps of many hosts,
+// with hosts that don't have the majority value.
+class FleetDiffWindow final : public QMainWindow {
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(FleetDiffWindow)
+ public:
+    explicit FleetDiffWindow(const QStringList& dump_paths, QWidget* parent = nullptr);
+    virtual ~FleetDiffWindow();
+
+ private:
+    QTreeWidget* m_tree_diff = new QTreeWidget(this);
+    TaskScheduler m_scheduler{1};
+
+    void on_fleet_loaded(FleetDiff&& fleet_diff) noexcept;
+};
+
+#endif  // FLEET_DIFF_WINDOW_HPP_
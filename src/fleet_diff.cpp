@@ -0,0 +1,193 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "fleet_diff.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>      // for sort, stable_sort, min
+#include <array>          // for array
+#include <atomic>         // for atomic
+#include <filesystem>     // for path
+#include <fstream>        // for ifstream
+#include <functional>     // for hash
+#include <mutex>          // for mutex, lock_guard
+#include <thread>         // for jthread
+#include <unordered_map>  // for unordered_map
+
+#include <fmt/core.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Amount of independently locked parts of the key table.
+constexpr std::size_t KEY_SHARDS = 64;
+
+// Key table shared between parsing threads.
+// Sharding keeps threads from contending on a single lock.
+class KeyTable final {
+ public:
+    std::uint32_t intern(std::string&& key) noexcept {
+        auto& shard = m_shards[std::hash<std::string>{}(key) % KEY_SHARDS];
+
+        const std::lock_guard<std::mutex> guard(shard.mutex);
+        auto [it, inserted] = shard.ids.try_emplace(std::move(key), 0);
+        if (inserted) {
+            it->second = m_next_id.fetch_add(1, std::memory_order_relaxed);
+        }
+        return it->second;
+    }
+
+    // Must be called once all threads are done.
+    std::vector<std::string_view> get_names() const noexcept {
+        std::vector<std::string_view> names(m_next_id.load(std::memory_order_relaxed));
+        for (auto&& shard : m_shards) {
+            for (auto&& [name, id] : shard.ids) {
+                names[id] = name;
+            }
+        }
+        return names;
+    }
+
+ private:
+    struct Shard {
+        std::mutex mutex{};
+        std::unordered_map<std::string, std::uint32_t> ids{};
+    };
+
+    std::array<Shard, KEY_SHARDS> m_shards{};
+    std::atomic<std::uint32_t> m_next_id{};
+};
+
+struct HostEntry {
+    std::uint32_t key{};
+    std::string value{};
+};
+
+auto parse_dump(const std::string& dump_path, KeyTable& key_table, std::vector<HostEntry>& entries) noexcept -> bool {
+    std::ifstream dump_stream{dump_path};
+    if (!dump_stream.is_open()) {
+        return false;
+    }
+
+    std::string line{};
+    while (std::getline(dump_stream, line)) {
+        std::string_view key{};
+        std::string_view value{};
+        if (!SysctlOption::parse_conf_line(line, key, value)) {
+            continue;
+        }
+
+        std::string option_name{key};
+        SysctlOption::normalize_name(option_name);
+        entries.emplace_back(HostEntry{.key = key_table.intern(std::move(option_name)), .value = SysctlOption::normalize_value(value)});
+    }
+
+    // Last occurence of the key wins, like with sysctl.conf.
+    std::stable_sort(entries.begin(), entries.end(), [](auto&& lhs, auto&& rhs) { return lhs.key < rhs.key; });
+    auto last = std::unique(entries.rbegin(), entries.rend(), [](auto&& lhs, auto&& rhs) { return lhs.key == rhs.key; });
+    entries.erase(entries.begin(), last.base());
+    return true;
+}
+
+}  // namespace
+
+FleetDiff FleetDiff::load(std::span<const std::string> dump_paths) noexcept {
+    FleetDiff fleet_diff{};
+
+    KeyTable key_table{};
+    std::vector<std::vector<HostEntry>> host_entries(dump_paths.size());
+    std::vector<std::uint8_t> loaded(dump_paths.size());
+
+    // Parse dumps in parallel, each thread takes next unparsed one.
+    {
+        std::atomic<std::size_t> next_dump{};
+        const auto thread_count = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1U), dump_paths.size());
+
+        std::vector<std::jthread> workers{};
+        workers.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; ++i) {
+            workers.emplace_back([&] {
+                for (auto dump = next_dump.fetch_add(1); dump < dump_paths.size(); dump = next_dump.fetch_add(1)) {
+                    loaded[dump] = parse_dump(dump_paths[dump], key_table, host_entries[dump]) ? 1 : 0;
+                }
+            });
+        }
+    }
+
+    // Keep only loaded hosts.
+    std::vector<std::vector<HostEntry>> hosts{};
+    for (std::size_t i = 0; i < dump_paths.size(); ++i) {
+        if (loaded[i] == 0) {
+            fmt::print(stderr, "Failed to read := '{}'\n", dump_paths[i]);
+            fleet_diff.m_failed.emplace_back(dump_paths[i]);
+            continue;
+        }
+        fleet_diff.m_hosts.emplace_back(fs::path{dump_paths[i]}.stem().string());
+        hosts.emplace_back(std::move(host_entries[i]));
+    }
+
+    // Group values of every key across hosts.
+    const auto& key_names = key_table.get_names();
+    fleet_diff.m_key_count = key_names.size();
+
+    std::vector<std::vector<std::pair<std::string_view, std::uint32_t>>> key_values(key_names.size());
+    for (std::size_t host = 0; host < hosts.size(); ++host) {
+        for (auto&& entry : hosts[host]) {
+            key_values[entry.key].emplace_back(entry.value, static_cast<std::uint32_t>(host));
+        }
+    }
+
+    for (std::size_t key = 0; key < key_names.size(); ++key) {
+        auto& values = key_values[key];
+        std::sort(values.begin(), values.end());
+
+        KeyDiff key_diff{.key = std::string{key_names[key]}, .values = {}, .missing = {}};
+        std::vector<std::uint8_t> present(hosts.size());
+        for (auto&& [value, host] : values) {
+            if (key_diff.values.empty() || key_diff.values.back().value != value) {
+                key_diff.values.emplace_back(ValueGroup{.value = std::string{value}, .hosts = {}, .deviation = {}});
+            }
+            key_diff.values.back().hosts.push_back(host);
+            present[host] = 1;
+        }
+        for (std::uint32_t host = 0; host < hosts.size(); ++host) {
+            if (present[host] == 0) {
+                key_diff.missing.push_back(host);
+            }
+        }
+
+        // Same value on every host.
+        if (key_diff.values.size() <= 1 && key_diff.missing.empty()) {
+            continue;
+        }
+
+        std::stable_sort(key_diff.values.begin(), key_diff.values.end(), [](auto&& lhs, auto&& rhs) { return lhs.hosts.size() > rhs.hosts.size(); });
+        if (const auto majority = OptionNumber::parse_first(key_diff.values.front().value); majority) {
+            for (auto&& group : key_diff.values) {
+                if (const auto number = OptionNumber::parse_first(group.value); number) {
+                    group.deviation = *number - *majority;
+                }
+            }
+        }
+        fleet_diff.m_differences.emplace_back(std::move(key_diff));
+    }
+
+    std::sort(fleet_diff.m_differences.begin(), fleet_diff.m_differences.end(), [](auto&& lhs, auto&& rhs) { return lhs.key < rhs.key; });
+    return fleet_diff;
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLEET_DIFF_HPP
+#define FLEET_DIFF_HPP
+
+#include "option_number.hpp"
+
+#include <cstdint>      // for uint32_t
+#include <optional>     // for optional
+#include <span>         // for span
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+// Compares sysctl dumps collected from many hosts.
+//
+// Accepts `sysctl -a` output and sysctl.conf style files (`key = value`),
+// keys may be either dotted or slashed. Dumps are parsed in parallel,
+// with keys interned into one shared table.
+class FleetDiff final {
+ public:
+    struct ValueGroup {
+        std::string value{};
+        // Indices into get_hosts().
+        std::vector<std::uint32_t> hosts{};
+        // Difference of the first numeric field from the majority value.
+        std::optional<OptionNumber> deviation{};
+    };
+
+    struct KeyDiff {
+        std::string key{};
+        // Sorted by host count, majority value goes first.
+        std::vector<ValueGroup> values{};
+        // Hosts, where key is missing.
+        std::vector<std::uint32_t> missing{};
+    };
+
+    // Loads dumps, host name is the file name without extension.
+    static FleetDiff load(std::span<const std::string> dump_paths) noexcept;
+
+    /* clang-format off */
+    inline std::span<const std::string> get_hosts() const noexcept
+    { return m_hosts; }
+
+    // Dumps, which could not be read.
+    inline std::span<const std::string> get_failed() const noexcept
+    { return m_failed; }
+
+    inline std::size_t get_key_count() const noexcept
+    { return m_key_count; }
+
+    // Keys, which are not same on all hosts, sorted by name.
+    inline std::span<const KeyDiff> get_differences() const noexcept
+    { return m_differences; }
+    /* clang-format on */
+
+ private:
+    std::vector<std::string> m_hosts{};
+    std::vector<std::string> m_failed{};
+    std::size_t m_key_count{};
+    std::vector<KeyDiff> m_differences{};
+};
+
+#endif  // FLEET_DIFF_HPP
@@ -0,0 +1,274 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "instance_link.hpp"
+#include "apply_journal.hpp"
+#include "sysctl_option.hpp"
+#include "utils.hpp"
+
+#include <unistd.h>  // for getuid
+
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace {
+
+constexpr int CONNECT_TIMEOUT_MSEC = 200;
+// Set and revert might wait for user to authenticate, so they have no timeout.
+constexpr int GET_REPLY_TIMEOUT_MSEC = 5000;
+
+auto read_reply(QLocalSocket& socket) noexcept -> instance_link::Reply {
+    return instance_link::parse_reply(QString::fromUtf8(socket.readLine()).trimmed());
+}
+
+}  // namespace
+
+namespace instance_link {
+
+QString server_name() noexcept {
+    return QStringLiteral("cachyos-sysctl-manager-%1").arg(::getuid());
+}
+
+QString format_request(const Request& request) noexcept {
+    switch (request.kind) {
+    case RequestKind::Get:
+        return QStringLiteral("get %1").arg(request.name);
+    case RequestKind::Set:
+        return QStringLiteral("set %1 %2").arg(request.name, request.value);
+    case RequestKind::RevertTo:
+        return QStringLiteral("revert-to %1").arg(request.value);
+    default:
+        return QStringLiteral("raise");
+    }
+}
+
+std::optional<Request> parse_request(const QString& line) noexcept {
+    const auto& command = line.section(' ', 0, 0);
+    if (command == QLatin1String("raise")) {
+        return Request{.kind = RequestKind::Raise};
+    }
+
+    const auto& option_name = line.section(' ', 1, 1);
+    if (option_name.isEmpty()) {
+        return std::nullopt;
+    }
+    if (command == QLatin1String("revert-to")) {
+        return Request{.kind = RequestKind::RevertTo, .value = option_name};
+    }
+    if (command == QLatin1String("get")) {
+        return Request{.kind = RequestKind::Get, .name = option_name};
+    }
+    if (command == QLatin1String("set")) {
+        // Value is the rest of the line, it might have several fields.
+        return Request{.kind = RequestKind::Set, .name = option_name, .value = line.section(' ', 2)};
+    }
+    return std::nullopt;
+}
+
+QString format_reply(const Reply& reply) noexcept {
+    return (reply.is_ok ? QStringLiteral("ok ") : QStringLiteral("error ")) + reply.text;
+}
+
+Reply parse_reply(const QString& line) noexcept {
+    const bool is_ok = line.startsWith(QLatin1String("ok "));
+    return Reply{.is_ok = is_ok, .text = line.section(' ', 1)};
+}
+
+Reply make_get_reply(const QString& option_name, const std::optional<std::string>& value) noexcept {
+    if (!value) {
+        return Reply{.is_ok = false, .text = QStringLiteral("%1: unknown option").arg(option_name)};
+    }
+    return Reply{.is_ok = true, .text = QStringLiteral("%1 = %2").arg(option_name, QString::fromStdString(*value))};
+}
+
+Reply make_set_reply(const ApplyResult& result) noexcept {
+    const auto& option_name = QString::fromStdString(result.name);
+    if (result.status == ApplyStatus::Applied || result.status == ApplyStatus::Clamped) {
+        return Reply{.is_ok = true, .text = QStringLiteral("%1 = %2").arg(option_name, QString::fromStdString(result.actual))};
+    }
+    return Reply{.is_ok = false, .text = QStringLiteral("%1: failed to set '%2'").arg(option_name, QString::fromStdString(result.requested))};
+}
+
+Reply make_revert_reply(std::span<const ApplyResult> results) noexcept {
+    QStringList failed_names;
+    for (auto&& result : results) {
+        if (result.status != ApplyStatus::Applied && result.status != ApplyStatus::Clamped) {
+            failed_names << QString::fromStdString(result.name);
+        }
+    }
+    if (!failed_names.isEmpty()) {
+        return Reply{.is_ok = false, .text = QStringLiteral("failed to revert: %1").arg(failed_names.join(QStringLiteral(", ")))};
+    }
+    return Reply{.is_ok = true, .text = QStringLiteral("%1 option(s) reverted").arg(results.size())};
+}
+
+std::optional<std::int64_t> parse_revert_time(std::span<const Request> requests) noexcept {
+    /* clang-format off */
+    if (requests.size() != 1) { return std::nullopt; }
+    /* clang-format on */
+
+    bool is_valid{};
+    const auto timestamp = requests.front().value.toLongLong(&is_valid);
+    /* clang-format off */
+    if (!is_valid) { return std::nullopt; }
+    /* clang-format on */
+    return std::int64_t{timestamp};
+}
+
+bool normalize_option(const QString& option, std::string& raw_path, QString& option_name) noexcept {
+    raw_path = option.toStdString();
+    SysctlOption::normalize_path(raw_path);
+
+    std::string name{raw_path};
+    SysctlOption::normalize_name(name);
+    option_name = QString::fromStdString(name);
+    return SysctlOption::is_option_path(raw_path);
+}
+
+bool remove_stale_server() noexcept {
+    const auto& name = server_name();
+    QLocalSocket socket;
+    socket.connectToServer(name);
+    if (socket.waitForConnected(CONNECT_TIMEOUT_MSEC)) {
+        socket.disconnectFromServer();
+        return false;
+    }
+
+    // Only refused connection tells that nobody listens, timeout might be a busy instance.
+    const auto socket_error = socket.error();
+    if (socket_error != QLocalSocket::ConnectionRefusedError && socket_error != QLocalSocket::ServerNotFoundError) {
+        return false;
+    }
+    return QLocalServer::removeServer(name);
+}
+
+std::optional<std::vector<Reply>> send_requests(std::span<const Request> requests) noexcept {
+    QLocalSocket socket;
+    socket.connectToServer(server_name());
+    if (!socket.waitForConnected(CONNECT_TIMEOUT_MSEC)) {
+        return std::nullopt;
+    }
+
+    QByteArray payload;
+    bool has_apply{};
+    for (auto&& request : requests) {
+        payload += format_request(request).toUtf8();
+        payload += '\n';
+        has_apply |= (request.kind == RequestKind::Set || request.kind == RequestKind::RevertTo);
+    }
+    payload += '\n';
+    socket.write(payload);
+
+    const int reply_timeout = has_apply ? -1 : GET_REPLY_TIMEOUT_MSEC;
+    std::vector<Reply> replies;
+    replies.reserve(requests.size());
+    while (replies.size() < requests.size()) {
+        while (socket.canReadLine()) {
+            replies.emplace_back(read_reply(socket));
+        }
+        if (replies.size() >= requests.size() || !socket.waitForReadyRead(reply_timeout)) {
+            break;
+        }
+    }
+    // Server closed the connection, before all lines were read.
+    while (replies.size() < requests.size() && socket.canReadLine()) {
+        replies.emplace_back(read_reply(socket));
+    }
+    while (replies.size() < requests.size()) {
+        replies.emplace_back(Reply{.is_ok = false, .text = QStringLiteral("no reply from running instance")});
+    }
+    return replies;
+}
+
+std::vector<Reply> handle_requests_locally(std::span<const Request> requests) noexcept {
+    std::vector<Reply> replies;
+    std::vector<ApplyChange> changes;
+    ApplyJournal journal;
+    bool is_revert{};
+
+    for (auto&& request : requests) {
+        std::string raw_path{};
+        QString option_name{};
+        const bool is_option = normalize_option(request.name, raw_path, option_name);
+
+        switch (request.kind) {
+        case RequestKind::Get:
+            if (!is_option) {
+                replies.emplace_back(make_get_reply(option_name, std::nullopt));
+                break;
+            }
+            replies.emplace_back(make_get_reply(option_name, SysctlOption::read_value(raw_path)));
+            break;
+        case RequestKind::Set: {
+            auto old_value = is_option ? SysctlOption::read_value(raw_path) : std::nullopt;
+            if (!old_value) {
+                replies.emplace_back(make_get_reply(option_name, old_value));
+                break;
+            }
+            changes.emplace_back(ApplyChange{
+                .raw       = std::move(raw_path),
+                .name      = option_name.toStdString(),
+                .old_value = std::move(*old_value),
+                .new_value = request.value.toStdString()});
+            break;
+        }
+        case RequestKind::RevertTo: {
+            const auto& revert_time = parse_revert_time(requests);
+            if (!revert_time) {
+                replies.emplace_back(Reply{.is_ok = false, .text = QStringLiteral("revert-to needs a time, and can't be combined with other requests")});
+                break;
+            }
+            if (!journal.open(ApplyJournal::default_path())) {
+                replies.emplace_back(Reply{.is_ok = false, .text = QStringLiteral("failed to open journal")});
+                break;
+            }
+            changes = journal.revert_to(*revert_time);
+            if (changes.empty()) {
+                replies.emplace_back(Reply{.is_ok = true, .text = QStringLiteral("options already have these values")});
+            }
+            is_revert = true;
+            break;
+        }
+        default:
+            replies.emplace_back(Reply{.is_ok = false, .text = QStringLiteral("no running instance")});
+            break;
+        }
+    }
+    /* clang-format off */
+    if (changes.empty()) { return replies; }
+    /* clang-format on */
+
+    // Sets are applied together, as one transaction.
+    const ApplyTransaction transaction{std::move(changes)};
+    const auto& results = transaction.execute([](auto&& script) { utils::runCmdTerminal(script.c_str(), true); });
+
+    if (journal.is_open() || journal.open(ApplyJournal::default_path())) {
+        journal.append(transaction.get_changes(), results);
+    }
+    if (is_revert) {
+        replies.emplace_back(make_revert_reply(results));
+        return replies;
+    }
+    for (auto&& result : results) {
+        replies.emplace_back(make_set_reply(result));
+    }
+    return replies;
+}
+
+}  // namespace instance_link
@@ -0,0 +1,97 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef INSTANCE_LINK_HPP
+#define INSTANCE_LINK_HPP
+
+#include "apply_transaction.hpp"
+
+#include <cstdint>   // for int64_t
+#include <optional>  // for optional
+#include <span>      // for span
+#include <string>    // for string
+#include <vector>    // for vector
+
+#include <QString>
+#include <QStringList>
+
+// Hands requests of a second launch over to the running instance, through a local socket.
+//
+// Protocol is line based: client sends requests, one per line, followed by an empty line.
+// Server replies with one line per request (`ok <text>` or `error <text>`), and closes
+// the connection. Sets are applied together as one transaction, so their replies come last.
+namespace instance_link {
+
+enum class RequestKind {
+    // Show the window of the running instance.
+    Raise,
+    // Current value of the option.
+    Get,
+    // Applies new value of the option.
+    Set,
+    // Reverts applies made after `value` (seconds since epoch), can't be combined with other requests.
+    RevertTo,
+};
+
+struct Request {
+    RequestKind kind{RequestKind::Raise};
+    QString name{};
+    QString value{};
+};
+
+struct Reply {
+    bool is_ok{};
+    QString text{};
+};
+
+// Per-user name of the socket.
+QString server_name() noexcept;
+
+QString format_request(const Request& request) noexcept;
+std::optional<Request> parse_request(const QString& line) noexcept;
+
+QString format_reply(const Reply& reply) noexcept;
+Reply parse_reply(const QString& line) noexcept;
+
+// Replies for `get`, and for `set` once it's applied.
+Reply make_get_reply(const QString& option_name, const std::optional<std::string>& value) noexcept;
+Reply make_set_reply(const ApplyResult& result) noexcept;
+Reply make_revert_reply(std::span<const ApplyResult> results) noexcept;
+
+// Checks that revert is the only request, and parses its time.
+std::optional<std::int64_t> parse_revert_time(std::span<const Request> requests) noexcept;
+
+// Converts option name or path into the path relative to SysctlOption::PROC_PATH, and the option name.
+// Returns false, if the path doesn't name an option file under SysctlOption::PROC_PATH.
+bool normalize_option(const QString& option, std::string& raw_path, QString& option_name) noexcept;
+
+// Removes the socket left by a crashed instance.
+// Returns false, if the socket is still served, or it can't be probed.
+bool remove_stale_server() noexcept;
+
+// Sends requests to the running instance.
+// Returns nothing, if there is no running instance.
+std::optional<std::vector<Reply>> send_requests(std::span<const Request> requests) noexcept;
+
+// Handles requests without the running instance, reading and writing options directly.
+std::vector<Reply> handle_requests_locally(std::span<const Request> requests) noexcept;
+
+}  // namespace instance_link
+
+#endif  // INSTANCE_LINK_HPP
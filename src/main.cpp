@@ -16,10 +16,22 @@
 // with this program; if not, write to the Free Software Foundation, Inc.,
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 
+#include "fleet-diff-window.hpp"
+#include "instance_link.hpp"
 #include "sm-window.hpp"
 
+#include <cstdint>      // for int64_t
+#include <memory>       // for unique_ptr, make_unique
+#include <optional>     // for optional
+#include <span>         // for span
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+#include <fmt/core.h>
+
 #include <QApplication>
-#include <QSharedMemory>
+#include <QCommandLineParser>
+#include <QDateTime>
 #include <QTranslator>
 
 #if defined(__clang__)
@@ -42,19 +54,44 @@
 
 namespace {
 
-bool IsInstanceAlreadyRunning(QSharedMemory& memoryLock) noexcept {
-    if (!memoryLock.create(1)) {
-        memoryLock.attach();
-        memoryLock.detach();
-
-        if (!memoryLock.create(1)) {
+// Scripted requests don't show any window.
+bool has_headless_request(int argc, char** argv) noexcept {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};  // NOLINT
+        if (arg.starts_with("--get") || arg.starts_with("--set") || arg.starts_with("--revert-to")) {
             return true;
         }
     }
-
     return false;
 }
 
+// Seconds since epoch, or local date and time in ISO 8601 format.
+auto parse_revert_time(const QString& text) noexcept -> std::optional<std::int64_t> {
+    bool is_number{};
+    const auto seconds = text.toLongLong(&is_number);
+    if (is_number) {
+        return std::int64_t{seconds};
+    }
+    const auto& date_time = QDateTime::fromString(text, Qt::ISODate);
+    /* clang-format off */
+    if (!date_time.isValid()) { return std::nullopt; }
+    /* clang-format on */
+    return std::int64_t{date_time.toSecsSinceEpoch()};
+}
+
+auto print_replies(std::span<const instance_link::Reply> replies) noexcept -> std::int32_t {
+    std::int32_t exit_code{};
+    for (auto&& reply : replies) {
+        if (!reply.is_ok) {
+            fmt::print(stderr, "{}\n", reply.text.toStdString());
+            exit_code = 1;
+        } else if (!reply.text.isEmpty()) {
+            fmt::print("{}\n", reply.text.toStdString());
+        }
+    }
+    return exit_code;
+}
+
 /* Adopted from bitcoin-qt source code.
  * Licensed under MIT
  */
@@ -108,11 +145,6 @@ void initTranslations(QTranslator& qtTranslatorBase, QTranslator& qtTranslator,
 }  // namespace
 
 auto main(int argc, char** argv) -> std::int32_t {
-    QSharedMemory sharedMemoryLock("CachyOS-SM-lock");
-    if (IsInstanceAlreadyRunning(sharedMemoryLock)) {
-        return -1;
-    }
-
     /// 1. Basic Qt initialization (not dependent on parameters or configuration)
 #if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
     // Generate high-dpi pixmaps
@@ -126,7 +158,14 @@ auto main(int argc, char** argv) -> std::int32_t {
     QApplication::setApplicationName("CachyOS-SM");
 
     // Set application attributes
-    const QApplication app(argc, argv);
+    // Headless requests don't need to connect to display server.
+    const bool is_headless = has_headless_request(argc, argv);
+    std::unique_ptr<QCoreApplication> app{};
+    if (is_headless) {
+        app = std::make_unique<QCoreApplication>(argc, argv);
+    } else {
+        app = std::make_unique<QApplication>(argc, argv);
+    }
 
     /// 3. Initialization of translations
     QTranslator qtTranslatorBase;
@@ -135,7 +174,90 @@ auto main(int argc, char** argv) -> std::int32_t {
     QTranslator translator;
     initTranslations(qtTranslatorBase, qtTranslator, translatorBase, translator);
 
-    MainWindow w;
+    /// 4. Command line
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QApplication::tr("Manage linux kernel options via sysctl"));
+    parser.addHelpOption();
+
+    const QCommandLineOption fleet_diff_option(QStringLiteral("fleet-diff"),
+        QApplication::tr("Compare sysctl dumps of many hosts (`sysctl -a` output or sysctl.conf files)."));
+    parser.addOption(fleet_diff_option);
+
+    const QCommandLineOption scope_option(QStringLiteral("scope"),
+        QApplication::tr("Scan only options under <prefix> (e.g net.ipv4 or vm). Can be repeated."), QStringLiteral("prefix"));
+    const QCommandLineOption exclude_option(QStringLiteral("exclude"),
+        QApplication::tr("Skip options under <prefix>. Can be repeated."), QStringLiteral("prefix"));
+    const QCommandLineOption tree_option(QStringLiteral("tree"),
+        QApplication::tr("Group options by directories, values are read when directory is expanded."));
+    parser.addOption(scope_option);
+    parser.addOption(exclude_option);
+    parser.addOption(tree_option);
+
+    const QCommandLineOption get_option(QStringLiteral("get"),
+        QApplication::tr("Print current value of <option>. Can be repeated."), QStringLiteral("option"));
+    const QCommandLineOption set_option(QStringLiteral("set"),
+        QApplication::tr("Apply <option=value>. Can be repeated, all values are applied together."), QStringLiteral("option=value"));
+    const QCommandLineOption revert_to_option(QStringLiteral("revert-to"),
+        QApplication::tr("Revert all applies made after <time> (seconds since epoch, or e.g 2024-05-01T12:00:00)."), QStringLiteral("time"));
+    parser.addOption(get_option);
+    parser.addOption(set_option);
+    parser.addOption(revert_to_option);
+    parser.addPositionalArgument(QStringLiteral("dumps"), QApplication::tr("Dump files to compare with --fleet-diff."), QStringLiteral("[dumps...]"));
+    parser.process(*app);
+
+    // Offline mode, doesn't touch local options.
+    if (!is_headless && parser.isSet(fleet_diff_option)) {
+        FleetDiffWindow fleet_window(parser.positionalArguments());
+        fleet_window.show();
+        return app->exec();  // NOLINT
+    }
+
+    std::vector<instance_link::Request> requests{};
+    for (auto&& option_name : parser.values(get_option)) {
+        requests.emplace_back(instance_link::Request{.kind = instance_link::RequestKind::Get, .name = option_name});
+    }
+    for (auto&& assignment : parser.values(set_option)) {
+        const auto& option_name = assignment.section('=', 0, 0).trimmed();
+        if (!assignment.contains('=') || option_name.isEmpty()) {
+            fmt::print(stderr, "Invalid assignment := '{}'\n", assignment.toStdString());
+            return 1;
+        }
+        requests.emplace_back(instance_link::Request{.kind = instance_link::RequestKind::Set, .name = option_name, .value = assignment.section('=', 1).trimmed()});
+    }
+    if (parser.isSet(revert_to_option)) {
+        const auto& revert_time = parse_revert_time(parser.value(revert_to_option));
+        if (!revert_time) {
+            fmt::print(stderr, "Invalid time := '{}'\n", parser.value(revert_to_option).toStdString());
+            return 1;
+        }
+        if (!requests.empty()) {
+            fmt::print(stderr, "--revert-to can't be combined with --get or --set\n");
+            return 1;
+        }
+        requests.emplace_back(instance_link::Request{.kind = instance_link::RequestKind::RevertTo, .value = QString::number(*revert_time)});
+    }
+    if (requests.empty()) {
+        requests.emplace_back(instance_link::Request{.kind = instance_link::RequestKind::Raise});
+    }
+
+    // Running instance answers from its option table, or raises its window.
+    if (auto replies = instance_link::send_requests(requests)) {
+        return print_replies(*replies);
+    }
+    if (is_headless) {
+        return print_replies(instance_link::handle_requests_locally(requests));
+    }
+
+    auto scan_rules = ScanRules::default_rules();
+    for (auto&& prefix : parser.values(scope_option)) {
+        scan_rules.add_include(prefix.toStdString());
+    }
+    for (auto&& prefix : parser.values(exclude_option)) {
+        scan_rules.add_exclude(prefix.toStdString());
+    }
+
+    MainWindow w(std::move(scan_rules), parser.isSet(tree_option));
+    w.listen_for_instances();
     w.show();
-    return app.exec();  // NOLINT
+    return app->exec();  // NOLINT
 }
@@ -0,0 +1,62 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "option_number.hpp"
+
+#include <algorithm>     // for min
+#include <charconv>      // for from_chars
+#include <system_error>  // for errc
+
+#include <fmt/core.h>
+
+namespace {
+
+constexpr std::string_view FIELD_SEPARATORS = " \t\n";
+
+}  // namespace
+
+std::optional<OptionNumber> OptionNumber::parse(std::string_view text) noexcept {
+    const bool negative = text.starts_with('-');
+    if (negative) {
+        text.remove_prefix(1);
+    }
+
+    // from_chars alone would accept another sign.
+    std::uint64_t magnitude{};
+    const auto* end      = text.data() + text.size();
+    const auto [ptr, ec] = std::from_chars(text.data(), end, magnitude);
+    if (text.empty() || text.front() < '0' || text.front() > '9' || ec != std::errc{} || ptr != end) {
+        return std::nullopt;
+    }
+    return OptionNumber{negative, magnitude};
+}
+
+std::optional<OptionNumber> OptionNumber::parse_first(std::string_view value) noexcept {
+    value.remove_prefix(std::min(value.find_first_not_of(FIELD_SEPARATORS), value.size()));
+    return parse(value.substr(0, value.find_first_of(FIELD_SEPARATORS)));
+}
+
+double OptionNumber::to_double() const noexcept {
+    const auto magnitude = static_cast<double>(m_magnitude);
+    return m_negative ? -magnitude : magnitude;
+}
+
+std::string OptionNumber::to_string() const noexcept {
+    return fmt::format("{}{}", m_negative ? "-" : "", m_magnitude);
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef OPTION_NUMBER_HPP
+#define OPTION_NUMBER_HPP
+
+#include <compare>      // for strong_ordering
+#include <cstdint>      // for uint64_t
+#include <limits>       // for numeric_limits
+#include <optional>     // for optional
+#include <string>       // for string
+#include <string_view>  // for string_view
+
+// Integer value of an option, wide enough for both negative and unsigned 64-bit values (e.g `kernel.shmmax`).
+// Kept as sign and magnitude, zero is never negative.
+class OptionNumber final {
+ public:
+    constexpr OptionNumber() = default;
+    constexpr OptionNumber(bool negative, std::uint64_t magnitude) noexcept
+      : m_magnitude(magnitude), m_negative(negative && magnitude != 0) { }
+
+    // Parses the whole `text`, an optional '-' followed by digits.
+    static std::optional<OptionNumber> parse(std::string_view text) noexcept;
+
+    // Parses first field of the option value, e.g `fs.file-nr`.
+    static std::optional<OptionNumber> parse_first(std::string_view value) noexcept;
+
+    /* clang-format off */
+    inline constexpr bool is_negative() const noexcept
+    { return m_negative; }
+
+    inline constexpr std::uint64_t get_magnitude() const noexcept
+    { return m_magnitude; }
+    /* clang-format on */
+
+    // Difference of two values, magnitude saturates at uint64 max.
+    constexpr OptionNumber operator-(const OptionNumber& rhs) const noexcept {
+        if (m_negative != rhs.m_negative) {
+            const auto magnitude = m_magnitude + rhs.m_magnitude;
+            return {m_negative, (magnitude < m_magnitude) ? std::numeric_limits<std::uint64_t>::max() : magnitude};
+        }
+        if (m_magnitude >= rhs.m_magnitude) {
+            return {m_negative, m_magnitude - rhs.m_magnitude};
+        }
+        return {!m_negative, rhs.m_magnitude - m_magnitude};
+    }
+
+    friend constexpr std::strong_ordering operator<=>(const OptionNumber& lhs, const OptionNumber& rhs) noexcept {
+        if (lhs.m_negative != rhs.m_negative) {
+            return lhs.m_negative ? std::strong_ordering::less : std::strong_ordering::greater;
+        }
+        return lhs.m_negative ? (rhs.m_magnitude <=> lhs.m_magnitude) : (lhs.m_magnitude <=> rhs.m_magnitude);
+    }
+    friend constexpr bool operator==(const OptionNumber& lhs, const OptionNumber& rhs) noexcept = default;
+
+    double to_double() const noexcept;
+    std::string to_string() const noexcept;
+
+ private:
+    std::uint64_t m_magnitude{};
+    bool m_negative{};
+};
+
+#endif  // OPTION_NUMBER_HPP
@@ -0,0 +1,325 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "option_query.hpp"
+
+#include <algorithm>  // for upper_bound, all_of, find_if
+#include <cctype>     // for tolower
+#include <iterator>   // for begin, end, distance
+
+#include <fmt/core.h>
+
+namespace {
+
+// Records are checked for cancellation in batches.
+constexpr std::size_t CANCEL_CHECK_INTERVAL = 1024;
+
+auto to_lower(std::string_view text) noexcept -> std::string {
+    std::string result{text};
+    for (auto&& ch : result) {
+        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    }
+    return result;
+}
+
+// Splits query into terms, removing double quotes.
+bool tokenize(std::string_view text, std::vector<std::string>& tokens) noexcept {
+    std::string token{};
+    bool in_token{};
+    bool in_quotes{};
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        const char ch = text[i];
+        if (ch == '"') {
+            in_quotes = !in_quotes;
+            in_token  = true;
+            continue;
+        }
+        if (ch == '\\' && in_quotes && i + 1 < text.size() && text[i + 1] == '"') {
+            token += text[++i];
+            continue;
+        }
+        if (!in_quotes && std::isspace(static_cast<unsigned char>(ch))) {
+            if (in_token) {
+                tokens.emplace_back(std::move(token));
+                token.clear();
+                in_token = false;
+            }
+            continue;
+        }
+        token += ch;
+        in_token = true;
+    }
+    if (in_token) {
+        tokens.emplace_back(std::move(token));
+    }
+    return !in_quotes;
+}
+
+// Matches `*` (any sequence) and `?` (any character) wildcards.
+bool glob_match(std::string_view pattern, std::string_view text) noexcept {
+    std::size_t pattern_pos{};
+    std::size_t text_pos{};
+    std::size_t star_pos  = std::string_view::npos;
+    std::size_t star_text = 0;
+
+    while (text_pos < text.size()) {
+        if (pattern_pos < pattern.size() && (pattern[pattern_pos] == '?' || pattern[pattern_pos] == text[text_pos])) {
+            ++pattern_pos;
+            ++text_pos;
+        } else if (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+            star_pos  = pattern_pos++;
+            star_text = text_pos;
+        } else if (star_pos != std::string_view::npos) {
+            // Let last `*` consume one more character.
+            pattern_pos = star_pos + 1;
+            text_pos    = ++star_text;
+        } else {
+            return false;
+        }
+    }
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '*') {
+        ++pattern_pos;
+    }
+    return pattern_pos == pattern.size();
+}
+
+auto longest_literal(std::string_view pattern) noexcept -> std::string_view {
+    std::string_view longest{};
+    while (!pattern.empty()) {
+        const auto literal = pattern.substr(0, pattern.find_first_of("*?"));
+        if (literal.size() > longest.size()) {
+            longest = literal;
+        }
+        pattern.remove_prefix(std::min(literal.size() + 1, pattern.size()));
+    }
+    return longest;
+}
+
+}  // namespace
+
+OptionIndex::OptionIndex(std::span<const SysctlOption> options) noexcept {
+    m_name_offsets.reserve(options.size() + 1);
+    m_value_offsets.reserve(options.size() + 1);
+    m_numbers.reserve(options.size());
+
+    for (auto&& option : options) {
+        m_name_offsets.push_back(m_names.size());
+        m_names += to_lower(option.get_name());
+        m_names += '\n';
+
+        m_value_offsets.push_back(m_values.size());
+        m_values += option.get_value();
+        m_values += '\n';
+
+        m_numbers.emplace_back(OptionNumber::parse_first(option.get_value()));
+    }
+    m_name_offsets.push_back(m_names.size());
+    m_value_offsets.push_back(m_values.size());
+}
+
+std::size_t OptionIndex::find_name_record(std::size_t pos) const noexcept {
+    const auto it = std::upper_bound(m_name_offsets.begin(), m_name_offsets.end(), pos);
+    return static_cast<std::size_t>(std::distance(m_name_offsets.begin(), it)) - 1;
+}
+
+std::optional<OptionQuery> OptionQuery::compile(std::string_view text, std::string& error) noexcept {
+    std::vector<std::string> tokens{};
+    if (!tokenize(text, tokens)) {
+        error = "Unterminated quote";
+        return std::nullopt;
+    }
+
+    OptionQuery query{};
+    for (auto&& token : tokens) {
+        std::string_view term{token};
+        const bool negate = term.size() > 1 && term.starts_with('-');
+        if (negate) {
+            term.remove_prefix(1);
+        }
+
+        if (term.starts_with("changed:")) {
+            const auto& operand = to_lower(term.substr(8));
+            if (operand == "yes" || operand == "true" || operand == "1") {
+                query.m_changed = !negate;
+            } else if (operand == "no" || operand == "false" || operand == "0") {
+                query.m_changed = negate;
+            } else {
+                error = fmt::format("Expected yes or no := '{}'", token);
+                return std::nullopt;
+            }
+            continue;
+        }
+
+        if (term.starts_with("category:")) {
+            query.m_name_terms.emplace_back(NameTerm{.kind = NameKind::Prefix, .pattern = to_lower(term.substr(9)) + '.', .literal = {}, .negate = negate});
+            query.m_name_terms.back().literal = query.m_name_terms.back().pattern;
+            continue;
+        }
+
+        if (term.starts_with("value")) {
+            static constexpr std::pair<std::string_view, ValueOp> VALUE_OPS[]{
+                {">=", ValueOp::GreaterEqual},
+                {"<=", ValueOp::LessEqual},
+                {"!=", ValueOp::NotEqual},
+                {">", ValueOp::Greater},
+                {"<", ValueOp::Less},
+                {"=", ValueOp::Equal},
+                {"~", ValueOp::Regex},
+                {":", ValueOp::Contains},
+            };
+
+            const auto rest = term.substr(5);
+            const auto* op  = std::find_if(std::begin(VALUE_OPS), std::end(VALUE_OPS), [rest](auto&& value_op) { return rest.starts_with(value_op.first); });
+            if (op != std::end(VALUE_OPS)) {
+                const auto operand = rest.substr(op->first.size());
+                if (operand.empty()) {
+                    error = fmt::format("Missing operand := '{}'", token);
+                    return std::nullopt;
+                }
+
+                ValueTerm value_term{.op = op->second, .number = OptionNumber::parse(operand), .text = std::string{operand}, .regex = {}, .negate = negate};
+                switch (value_term.op) {
+                case ValueOp::Less:
+                case ValueOp::LessEqual:
+                case ValueOp::Greater:
+                case ValueOp::GreaterEqual:
+                    if (!value_term.number) {
+                        error = fmt::format("Expected number := '{}'", token);
+                        return std::nullopt;
+                    }
+                    break;
+                case ValueOp::Regex:
+                    try {
+                        value_term.regex.emplace(value_term.text, std::regex::ECMAScript | std::regex::optimize);
+                    } catch (const std::regex_error& ex) {
+                        error = fmt::format("Invalid regex := '{}': {}", token, ex.what());
+                        return std::nullopt;
+                    }
+                    break;
+                default:
+                    break;
+                }
+                query.m_value_terms.emplace_back(std::move(value_term));
+                continue;
+            }
+        }
+
+        // Anything else is a name pattern.
+        if (term.starts_with("name:")) {
+            term.remove_prefix(5);
+        }
+        NameTerm name_term{.kind = NameKind::Substring, .pattern = to_lower(term), .literal = {}, .negate = negate};
+        if (name_term.pattern.find_first_of("*?") != std::string::npos) {
+            name_term.kind    = NameKind::Glob;
+            name_term.literal = longest_literal(name_term.pattern);
+        } else {
+            name_term.literal = name_term.pattern;
+        }
+        query.m_name_terms.emplace_back(std::move(name_term));
+    }
+    return query;
+}
+
+bool OptionQuery::match_name(const NameTerm& term, std::string_view name) noexcept {
+    switch (term.kind) {
+    case NameKind::Substring:
+        return name.find(term.pattern) != std::string_view::npos;
+    case NameKind::Glob:
+        return glob_match(term.pattern, name);
+    case NameKind::Prefix:
+        return name.starts_with(term.pattern);
+    }
+    return false;
+}
+
+bool OptionQuery::match_value(const ValueTerm& term, const OptionIndex& index, std::size_t option) noexcept {
+    const auto& number = index.get_number(option);
+    const auto value   = index.get_value(option);
+
+    switch (term.op) {
+    case ValueOp::Less:
+        return number && *number < *term.number;
+    case ValueOp::LessEqual:
+        return number && *number <= *term.number;
+    case ValueOp::Greater:
+        return number && *number > *term.number;
+    case ValueOp::GreaterEqual:
+        return number && *number >= *term.number;
+    case ValueOp::Equal:
+        return term.number ? (number && *number == *term.number) : (value == term.text);
+    case ValueOp::NotEqual:
+        return term.number ? !(number && *number == *term.number) : (value != term.text);
+    case ValueOp::Contains:
+        return value.find(term.text) != std::string_view::npos;
+    case ValueOp::Regex:
+        return std::regex_search(value.begin(), value.end(), *term.regex);
+    }
+    return false;
+}
+
+std::vector<bool> OptionQuery::match(const OptionIndex& index, std::span<const std::uint8_t> changed, const std::stop_token& stoken) const noexcept {
+    std::vector<bool> matched(index.size());
+
+    // Name terms first, then cheap pending change check, then value predicates.
+    const auto evaluate = [&](std::size_t option) {
+        const auto name = index.get_name(option);
+        for (auto&& term : m_name_terms) {
+            if (match_name(term, name) == term.negate) {
+                return false;
+            }
+        }
+        if (m_changed) {
+            const bool is_changed = option < changed.size() && changed[option] != 0;
+            if (is_changed != *m_changed) {
+                return false;
+            }
+        }
+        return std::all_of(m_value_terms.begin(), m_value_terms.end(),
+            [&](auto&& term) { return match_value(term, index, option) != term.negate; });
+    };
+
+    // Narrow down candidates by scanning the whole names buffer for the literal
+    // of a name term, instead of checking every option one by one.
+    const auto prefilter = std::find_if(m_name_terms.begin(), m_name_terms.end(),
+        [](auto&& term) { return !term.negate && !term.literal.empty(); });
+    if (prefilter != m_name_terms.end()) {
+        const auto names   = index.get_names();
+        const auto literal = std::string_view{prefilter->literal};
+
+        std::size_t checked{};
+        for (auto pos = names.find(literal); pos != std::string_view::npos; pos = names.find(literal, pos)) {
+            if ((++checked % CANCEL_CHECK_INTERVAL) == 0 && stoken.stop_requested()) {
+                break;
+            }
+            const auto option = index.find_name_record(pos);
+            matched[option]   = evaluate(option);
+
+            // Skip rest of the record, it's already evaluated.
+            pos = index.get_name_record_end(option);
+        }
+        return matched;
+    }
+
+    for (std::size_t option = 0; option < index.size(); ++option) {
+        if ((option % CANCEL_CHECK_INTERVAL) == 0 && stoken.stop_requested()) {
+            break;
+        }
+        matched[option] = evaluate(option);
+    }
+    return matched;
+}
@@ -0,0 +1,145 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef OPTION_QUERY_HPP
+#define OPTION_QUERY_HPP
+
+#include "option_number.hpp"
+#include "sysctl_option.hpp"
+
+#include <cstdint>      // for uint8_t
+#include <optional>     // for optional
+#include <regex>        // for regex
+#include <span>         // for span
+#include <stop_token>   // for stop_token
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+// Names and values of the option table, packed into contiguous buffers.
+// Records are separated with '\n', so a match never spans two of them.
+class OptionIndex final {
+ public:
+    explicit OptionIndex(std::span<const SysctlOption> options) noexcept;
+
+    /* clang-format off */
+    inline std::size_t size() const noexcept
+    { return m_name_offsets.size() - 1; }
+
+    inline std::string_view get_names() const noexcept
+    { return m_names; }
+
+    // Lowercase name of the option.
+    inline std::string_view get_name(std::size_t index) const noexcept
+    { return get_record(m_names, m_name_offsets, index); }
+
+    inline std::string_view get_value(std::size_t index) const noexcept
+    { return get_record(m_values, m_value_offsets, index); }
+
+    inline const std::optional<OptionNumber>& get_number(std::size_t index) const noexcept
+    { return m_numbers[index]; }
+    /* clang-format on */
+
+    // Returns index of the record, which contains position `pos` of the names buffer.
+    std::size_t find_name_record(std::size_t pos) const noexcept;
+
+    /* clang-format off */
+    // Position of the next record in the names buffer.
+    inline std::size_t get_name_record_end(std::size_t index) const noexcept
+    { return m_name_offsets[index + 1]; }
+    /* clang-format on */
+
+ private:
+    static std::string_view get_record(std::string_view buffer, std::span<const std::size_t> offsets, std::size_t index) noexcept {
+        // Offsets point to the record start, last one is the end of buffer.
+        return buffer.substr(offsets[index], offsets[index + 1] - offsets[index] - 1);
+    }
+
+    std::string m_names{};
+    std::string m_values{};
+    std::vector<std::size_t> m_name_offsets{};
+    std::vector<std::size_t> m_value_offsets{};
+    // First integer field of the value, if any.
+    std::vector<std::optional<OptionNumber>> m_numbers{};
+};
+
+// Search query over the option table, parsed once and compiled into a pipeline of predicates.
+//
+// Query is a list of whitespace separated terms, which all must match:
+//   net.ipv4.*          name glob (`*`, `?`), or a substring without them
+//   name:tcp            same, explicitly
+//   category:vm         first component of the name
+//   value>0             numeric comparison of the first field (>, >=, <, <=, =, !=)
+//   value=bbr           exact value, if operand isn't a number
+//   value:cubic         value substring
+//   value~"^1 "         value regular expression
+//   changed:yes         option has pending change
+// Prefix a term with `-` to negate it. Double quotes allow spaces in operands.
+class OptionQuery final {
+ public:
+    // Returns nothing on parse error, with description in `error`.
+    static std::optional<OptionQuery> compile(std::string_view text, std::string& error) noexcept;
+
+    // Evaluates query over the index. Name terms are evaluated first, by scanning
+    // the contiguous names buffer, and value predicates only on the remaining options.
+    // `changed` flags options with pending changes, it can be empty.
+    std::vector<bool> match(const OptionIndex& index, std::span<const std::uint8_t> changed, const std::stop_token& stoken) const noexcept;
+
+ private:
+    enum class NameKind : std::uint8_t {
+        Substring,
+        Glob,
+        Prefix,
+    };
+
+    struct NameTerm {
+        NameKind kind{};
+        std::string pattern{};
+        // Longest literal part of the pattern, used to prefilter by scanning the buffer.
+        std::string literal{};
+        bool negate{};
+    };
+
+    enum class ValueOp : std::uint8_t {
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual,
+        Contains,
+        Regex,
+    };
+
+    struct ValueTerm {
+        ValueOp op{};
+        std::optional<OptionNumber> number{};
+        std::string text{};
+        std::optional<std::regex> regex{};
+        bool negate{};
+    };
+
+    static bool match_name(const NameTerm& term, std::string_view name) noexcept;
+    static bool match_value(const ValueTerm& term, const OptionIndex& index, std::size_t option) noexcept;
+
+    std::vector<NameTerm> m_name_terms{};
+    std::vector<ValueTerm> m_value_terms{};
+    std::optional<bool> m_changed{};
+};
+
+#endif  // OPTION_QUERY_HPP
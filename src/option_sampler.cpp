@@ -0,0 +1,94 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "option_sampler.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>  // for clamp, max
+#include <array>      // for array
+
+#include <fmt/core.h>
+
+OptionSampler::OptionSampler(std::span<const std::string> raw_paths, std::uint32_t rate_hz) noexcept
+  : m_raw_paths(raw_paths.begin(), raw_paths.end()), m_rate_hz(std::clamp(rate_hz, MIN_RATE_HZ, MAX_RATE_HZ)) { }
+
+OptionSampler::~OptionSampler() noexcept {
+    stop();
+}
+
+bool OptionSampler::start() noexcept {
+    stop();
+
+    m_files.resize(m_raw_paths.size());
+    bool any_opened{};
+    for (std::size_t i = 0; i < m_raw_paths.size(); ++i) {
+        // Keep failed ones closed, so key indices stay stable.
+        if (!m_files[i].open(m_raw_paths[i])) {
+            fmt::print(stderr, "Failed to open := '{}{}'\n", SysctlOption::PROC_PATH, m_raw_paths[i]);
+        }
+        any_opened |= m_files[i].is_open();
+    }
+    if (!any_opened) {
+        stop();
+        return false;
+    }
+
+    m_thread = std::jthread([this](std::stop_token stoken) { sample_loop(std::move(stoken)); });
+    return true;
+}
+
+void OptionSampler::stop() noexcept {
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+    m_files.clear();
+}
+
+void OptionSampler::sample_loop(std::stop_token stoken) noexcept {
+    const auto period_ns = polling::NSEC_PER_SEC / m_rate_hz;
+    std::array<char, polling::MAX_VALUE_SIZE> buffer{};
+    auto next_tick = polling::monotonic_now();
+
+    while (!stoken.stop_requested()) {
+        for (std::size_t i = 0; i < m_files.size(); ++i) {
+            const auto& file = m_files[i];
+            /* clang-format off */
+            if (!file.is_open()) { continue; }
+            /* clang-format on */
+
+            const auto text = file.read(buffer);
+            /* clang-format off */
+            if (!text) { continue; }
+            /* clang-format on */
+
+            const auto value = OptionNumber::parse_first(*text);
+            /* clang-format off */
+            if (!value) { continue; }
+            /* clang-format on */
+            if (!m_ring.try_push(OptionSample{.key_index = static_cast<std::uint32_t>(i), .value = *value})) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Sleep until next tick, using absolute time to avoid drift.
+        // Skip missed ticks (e.g after suspend), instead of sampling in a burst.
+        next_tick = std::max(next_tick + period_ns, polling::monotonic_now());
+        polling::sleep_until(next_tick);
+    }
+}
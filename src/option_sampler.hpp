@@ -0,0 +1,92 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef OPTION_SAMPLER_HPP
+#define OPTION_SAMPLER_HPP
+
+#include "option_number.hpp"
+#include "polling.hpp"
+#include "spsc_ring.hpp"
+
+#include <atomic>       // for atomic
+#include <cstdint>      // for uint32_t, uint64_t
+#include <span>         // for span
+#include <stop_token>   // for stop_token
+#include <string>       // for string
+#include <thread>       // for jthread
+#include <vector>       // for vector
+
+struct OptionSample {
+    // Index of the key, in order passed to OptionSampler.
+    std::uint32_t key_index{};
+    OptionNumber value{};
+};
+
+// Periodically samples a fixed set of numeric options on a dedicated thread.
+//
+// Options are opened once on start, and read with `pread` on every tick.
+// Parsed values are pushed into a lock-free ring buffer, which is drained
+// by a single consumer. Sampling thread doesn't allocate once running.
+class OptionSampler final {
+ public:
+    static constexpr std::uint32_t MIN_RATE_HZ = 10;
+    static constexpr std::uint32_t MAX_RATE_HZ = 100;
+
+    // `raw_paths` are option paths relative to SysctlOption::PROC_PATH.
+    explicit OptionSampler(std::span<const std::string> raw_paths, std::uint32_t rate_hz) noexcept;
+    ~OptionSampler() noexcept;
+
+    OptionSampler(const OptionSampler&)            = delete;
+    OptionSampler& operator=(const OptionSampler&) = delete;
+
+    // Returns false, if none of the options could be opened.
+    bool start() noexcept;
+    void stop() noexcept;
+
+    // Pops all available samples. Must be called only from one thread.
+    template <typename Func>
+    std::size_t drain(Func&& on_sample) noexcept {
+        std::size_t count{};
+        OptionSample sample{};
+        while (m_ring.try_pop(sample)) {
+            on_sample(sample);
+            ++count;
+        }
+        return count;
+    }
+
+    /* clang-format off */
+    inline std::uint64_t get_dropped() const noexcept
+    { return m_dropped.load(std::memory_order_relaxed); }
+    /* clang-format on */
+
+ private:
+    static constexpr std::size_t RING_CAPACITY = 4096;
+
+    void sample_loop(std::stop_token stoken) noexcept;
+
+    std::vector<std::string> m_raw_paths{};
+    std::vector<polling::OptionFile> m_files{};
+    std::uint32_t m_rate_hz{};
+    std::atomic<std::uint64_t> m_dropped{};
+
+    SpscRing<OptionSample, RING_CAPACITY> m_ring{};
+    std::jthread m_thread{};
+};
+
+#endif  // OPTION_SAMPLER_HPP
@@ -0,0 +1,86 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "polling.hpp"
+#include "sysctl_option.hpp"
+
+#include <ctime>    // for clock_gettime, clock_nanosleep
+#include <utility>  // for exchange
+
+#include <unistd.h>  // for pread, pwrite, close
+
+#include <fmt/core.h>
+
+namespace polling {
+
+std::int64_t monotonic_now() noexcept {
+    timespec now{};
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return std::int64_t{now.tv_sec} * NSEC_PER_SEC + now.tv_nsec;
+}
+
+void sleep_until(std::int64_t deadline) noexcept {
+    timespec deadline_time{};
+    deadline_time.tv_sec  = deadline / NSEC_PER_SEC;
+    deadline_time.tv_nsec = deadline % NSEC_PER_SEC;
+    ::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_time, nullptr);
+}
+
+OptionFile::~OptionFile() noexcept {
+    close();
+}
+
+OptionFile::OptionFile(OptionFile&& other) noexcept
+  : m_fd(std::exchange(other.m_fd, -1)) { }
+
+OptionFile& OptionFile::operator=(OptionFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_fd = std::exchange(other.m_fd, -1);
+    }
+    return *this;
+}
+
+bool OptionFile::open(std::string_view raw_path, int flags) noexcept {
+    close();
+    const auto& file_path = fmt::format("{}{}", SysctlOption::PROC_PATH, raw_path);
+    m_fd                  = ::open(file_path.c_str(), flags | O_CLOEXEC);
+    return m_fd >= 0;
+}
+
+void OptionFile::close() noexcept {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+std::optional<std::string_view> OptionFile::read(std::span<char> buffer) const noexcept {
+    const auto bytes_read = ::pread(m_fd, buffer.data(), buffer.size(), 0);
+    /* clang-format off */
+    if (bytes_read < 0) { return std::nullopt; }
+    /* clang-format on */
+    return std::string_view{buffer.data(), static_cast<std::size_t>(bytes_read)};
+}
+
+bool OptionFile::write(std::string_view value) const noexcept {
+    return ::pwrite(m_fd, value.data(), value.size(), 0) >= 0;
+}
+
+}  // namespace polling
@@ -0,0 +1,79 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef POLLING_HPP
+#define POLLING_HPP
+
+#include <cstdint>      // for int64_t
+#include <optional>     // for optional
+#include <span>         // for span
+#include <string_view>  // for string_view
+
+#include <fcntl.h>  // for O_RDONLY
+
+// Helpers shared by loops, which poll options on a fixed schedule
+// (sampler, drift enforcer and Prometheus exporter).
+namespace polling {
+
+inline constexpr std::int64_t NSEC_PER_SEC = 1'000'000'000;
+
+// Large enough for any single option.
+inline constexpr std::size_t MAX_VALUE_SIZE = 4096;
+
+// CLOCK_MONOTONIC time, in nanoseconds.
+std::int64_t monotonic_now() noexcept;
+
+// Sleeps until `deadline` (CLOCK_MONOTONIC, nsec). Signals interrupt the sleep.
+void sleep_until(std::int64_t deadline) noexcept;
+
+// Option file, which is opened once and then read from the start on every poll.
+// Proc files are regenerated on each read, `pread` at offset 0 avoids reopening and seeking.
+class OptionFile final {
+ public:
+    OptionFile() = default;
+    ~OptionFile() noexcept;
+
+    OptionFile(OptionFile&& other) noexcept;
+    OptionFile& operator=(OptionFile&& other) noexcept;
+    OptionFile(const OptionFile&)            = delete;
+    OptionFile& operator=(const OptionFile&) = delete;
+
+    // Opens the option by its path relative to SysctlOption::PROC_PATH.
+    // On failure errno is left as set by `open`.
+    bool open(std::string_view raw_path, int flags = O_RDONLY) noexcept;
+    void close() noexcept;
+
+    /* clang-format off */
+    inline bool is_open() const noexcept
+    { return m_fd >= 0; }
+    /* clang-format on */
+
+    // Reads the whole value into `buffer`, returns nothing if the read failed
+    // (e.g the interface of the option is gone).
+    std::optional<std::string_view> read(std::span<char> buffer) const noexcept;
+
+    bool write(std::string_view value) const noexcept;
+
+ private:
+    int m_fd{-1};
+};
+
+}  // namespace polling
+
+#endif  // POLLING_HPP
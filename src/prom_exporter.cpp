@@ -0,0 +1,175 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#include "prom_exporter.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>  // for min, max, all_of
+#include <cstdio>     // for rename
+#include <iterator>   // for back_inserter
+
+#include <fcntl.h>   // for open
+#include <unistd.h>  // for write, close, unlink
+
+#include <fmt/core.h>
+
+namespace {
+
+constexpr std::string_view FIELD_DELIMS = " \t\n";
+
+// Calls `func` for every whitespace separated field of the value.
+template <typename Func>
+void for_each_field(std::string_view value, Func&& func) noexcept {
+    while (true) {
+        const auto first = value.find_first_not_of(FIELD_DELIMS);
+        /* clang-format off */
+        if (first == std::string_view::npos) { return; }
+        /* clang-format on */
+        value.remove_prefix(first);
+
+        const auto field_end = std::min(value.find_first_of(FIELD_DELIMS), value.size());
+        func(value.substr(0, field_end));
+        value.remove_prefix(field_end);
+    }
+}
+
+// Counts fields, returns 0 if any of them is not an integer.
+auto count_integer_fields(std::string_view value) noexcept -> std::size_t {
+    std::size_t field_count{};
+    bool all_integers{true};
+    for_each_field(value, [&](std::string_view field) {
+        // Text is copied as is, so no range limit, unsigned 64-bit values are common.
+        if (field.starts_with('-')) {
+            field.remove_prefix(1);
+        }
+        all_integers &= (!field.empty() && std::ranges::all_of(field, [](char ch) { return ch >= '0' && ch <= '9'; }));
+        ++field_count;
+    });
+    return all_integers ? field_count : 0;
+}
+
+}  // namespace
+
+PromExporter::PromExporter(std::string output_path, std::uint32_t interval_sec) noexcept
+  : m_output_path(std::move(output_path)), m_temp_path(m_output_path + ".tmp"), m_interval_sec(std::max(interval_sec, 1U)) {
+    m_read_buffer.resize(polling::MAX_VALUE_SIZE);
+}
+
+std::string PromExporter::to_metric_name(std::string_view option_name) noexcept {
+    std::string metric_name{"sysctl_"};
+    metric_name.reserve(metric_name.size() + option_name.size());
+    for (const char ch : option_name) {
+        const bool is_valid = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+        metric_name += is_valid ? ch : '_';
+    }
+    return metric_name;
+}
+
+bool PromExporter::select_options(const ScanRules& rules) noexcept {
+    for (auto&& option : SysctlOption::get_options(rules)) {
+        if (count_integer_fields(option.get_value()) == 0) {
+            continue;
+        }
+
+        polling::OptionFile file{};
+        if (!file.open(option.get_raw())) {
+            fmt::print(stderr, "Failed to open := '{}{}'\n", SysctlOption::PROC_PATH, option.get_raw());
+            continue;
+        }
+
+        auto&& metric_name = to_metric_name(option.get_name());
+        auto&& header      = fmt::format("# HELP {0} Value of {1}.\n# TYPE {0} gauge\n", metric_name, option.get_name());
+        m_metrics.emplace_back(Metric{.file = std::move(file), .header = std::move(header), .name = std::move(metric_name)});
+    }
+    return !m_metrics.empty();
+}
+
+void PromExporter::format_metric(const Metric& metric, std::string_view value) noexcept {
+    const auto field_count = count_integer_fields(value);
+    /* clang-format off */
+    if (field_count == 0) { return; }
+    /* clang-format on */
+
+    // Value is already in decimal, it's copied as is.
+    auto& buffer = m_output_buffer;
+    buffer += metric.header;
+    std::size_t field_index{};
+    for_each_field(value, [&](std::string_view field) {
+        buffer += metric.name;
+        if (field_count > 1) {
+            fmt::format_to(std::back_inserter(buffer), "{{field=\"{}\"}}", field_index++);
+        }
+        buffer += ' ';
+        buffer += field;
+        buffer += '\n';
+    });
+}
+
+bool PromExporter::refresh() noexcept {
+    m_output_buffer.clear();
+    for (auto&& metric : m_metrics) {
+        if (const auto value = metric.file.read(m_read_buffer); value) {
+            format_metric(metric, *value);
+        }
+    }
+
+    // Collector never sees partially written file, it's replaced with rename.
+    const int fd = ::open(m_temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fmt::print(stderr, "Failed to open := '{}'\n", m_temp_path);
+        return false;
+    }
+    std::string_view pending{m_output_buffer};
+    while (!pending.empty()) {
+        const auto bytes_written = ::write(fd, pending.data(), pending.size());
+        if (bytes_written < 0) {
+            break;
+        }
+        pending.remove_prefix(static_cast<std::size_t>(bytes_written));
+    }
+    ::close(fd);
+
+    if (!pending.empty() || std::rename(m_temp_path.c_str(), m_output_path.c_str()) != 0) {
+        fmt::print(stderr, "Failed to write := '{}'\n", m_output_path);
+        ::unlink(m_temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void PromExporter::run(const std::atomic<bool>& stop_requested) noexcept {
+    const auto period_ns = std::int64_t{m_interval_sec} * polling::NSEC_PER_SEC;
+    auto next_tick       = polling::monotonic_now();
+
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+        const auto now = polling::monotonic_now();
+        if (next_tick > now) {
+            // Signal interrupts the sleep, and stop flag is checked again.
+            polling::sleep_until(next_tick);
+            continue;
+        }
+
+        refresh();
+        // Skip missed ticks, instead of refreshing in a burst.
+        next_tick += period_ns;
+        if (next_tick <= now) {
+            next_tick = now + period_ns;
+        }
+    }
+}
@@ -0,0 +1,85 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+#ifndef PROM_EXPORTER_HPP
+#define PROM_EXPORTER_HPP
+
+#include "polling.hpp"
+#include "scan_rules.hpp"
+
+#include <atomic>       // for atomic
+#include <cstdint>      // for uint32_t
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <vector>       // for vector
+
+// Periodically writes numeric options into a Prometheus textfile (for node_exporter's
+// textfile collector), as `sysctl_<name>` gauges. Values with several fields are
+// split into series labelled with `field`.
+//
+// Options are selected once, from the scanned option table, and kept open.
+// Metric names are formatted up front, and the output buffer is reused,
+// so refreshes don't allocate once it has grown. File is replaced atomically.
+class PromExporter final {
+ public:
+    static constexpr std::uint32_t DEFAULT_INTERVAL_SEC = 5;
+
+    PromExporter(std::string output_path, std::uint32_t interval_sec = DEFAULT_INTERVAL_SEC) noexcept;
+
+    PromExporter(const PromExporter&)            = delete;
+    PromExporter& operator=(const PromExporter&) = delete;
+
+    // Scans options allowed by `rules`, and opens the numeric ones.
+    // Returns false, if there is nothing to export.
+    bool select_options(const ScanRules& rules) noexcept;
+
+    /* clang-format off */
+    inline std::size_t get_metric_count() const noexcept
+    { return m_metrics.size(); }
+    /* clang-format on */
+
+    // Reads options, and replaces the output file.
+    bool refresh() noexcept;
+
+    // Refreshes until `stop_requested` is set.
+    void run(const std::atomic<bool>& stop_requested) noexcept;
+
+    // Converts option name into the metric name, e.g `net.ipv4.tcp_mem` into `sysctl_net_ipv4_tcp_mem`.
+    static std::string to_metric_name(std::string_view option_name) noexcept;
+
+ private:
+    struct Metric {
+        polling::OptionFile file{};
+        // `# HELP` and `# TYPE` lines.
+        std::string header{};
+        std::string name{};
+    };
+
+    void format_metric(const Metric& metric, std::string_view value) noexcept;
+
+    std::string m_output_path{};
+    std::string m_temp_path{};
+    std::uint32_t m_interval_sec{};
+
+    std::vector<Metric> m_metrics{};
+    std::string m_read_buffer{};
+    std::string m_output_buffer{};
+};
+
+#endif  // PROM_EXPORTER_HPP
@@ -0,0 +1,178 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "scan_rules.hpp"
+#include "sysctl_option.hpp"
+
+#include <algorithm>  // for find, any_of
+
+namespace {
+
+constexpr std::uint32_t NO_NODE = 0;
+
+// Converts prefix into the path relative to PROC_PATH, without trailing '/'.
+auto normalize_prefix(std::string_view prefix) noexcept -> std::string {
+    std::string path{prefix};
+    SysctlOption::normalize_path(path);
+    while (path.ends_with('/')) {
+        path.pop_back();
+    }
+    return path;
+}
+
+// Calls `func` for every non-empty component of the path.
+// Stops early if `func` returns false.
+template <typename Func>
+void for_each_component(std::string_view path, Func&& func) noexcept {
+    while (!path.empty()) {
+        const auto delim_pos = path.find('/');
+        const auto component = path.substr(0, delim_pos);
+        if (!component.empty() && !func(component)) {
+            return;
+        }
+        path.remove_prefix((delim_pos == std::string_view::npos) ? path.size() : delim_pos + 1);
+    }
+}
+
+}  // namespace
+
+ScanRules::ScanRules() noexcept
+  : m_nodes(1) { }
+
+ScanRules ScanRules::default_rules() noexcept {
+    ScanRules rules{};
+    rules.add_exclude("debug");
+    rules.add_exclude("dev");
+    rules.add_excluded_name("base_reachable_time");
+    rules.add_excluded_name("retrans_time");
+    return rules;
+}
+
+void ScanRules::add_include(std::string_view prefix) noexcept {
+    add_rule(prefix, Action::Include);
+}
+
+void ScanRules::add_exclude(std::string_view prefix) noexcept {
+    add_rule(prefix, Action::Exclude);
+}
+
+void ScanRules::add_excluded_name(std::string_view file_name) noexcept {
+    m_excluded_names.emplace_back(file_name);
+}
+
+std::uint32_t ScanRules::find_child(std::uint32_t node, std::string_view component) const noexcept {
+    const auto& children = m_nodes[node].children;
+    const auto it        = std::find_if(children.begin(), children.end(), [component](auto&& child) { return child.first == component; });
+    return (it != children.end()) ? it->second : NO_NODE;
+}
+
+void ScanRules::add_rule(std::string_view prefix, Action action) noexcept {
+    const auto& path = normalize_prefix(prefix);
+
+    std::vector<std::uint32_t> trail{0};
+    for_each_component(path, [&](std::string_view component) {
+        auto child = find_child(trail.back(), component);
+        if (child == NO_NODE) {
+            child = static_cast<std::uint32_t>(m_nodes.size());
+            m_nodes[trail.back()].children.emplace_back(std::string{component}, child);
+            m_nodes.emplace_back();
+        }
+        trail.push_back(child);
+        return true;
+    });
+    m_nodes[trail.back()].action = action;
+
+    if (action == Action::Include) {
+        for (auto&& node : trail) {
+            m_nodes[node].has_include = true;
+        }
+        m_includes.emplace_back(path);
+    }
+}
+
+bool ScanRules::should_descend(std::string_view dir_path) const noexcept {
+    std::uint32_t node{};
+    bool matched_all{true};
+    auto last_action = m_nodes[0].action;
+
+    for_each_component(dir_path, [&](std::string_view component) {
+        node = find_child(node, component);
+        if (node == NO_NODE) {
+            matched_all = false;
+            return false;
+        }
+        if (m_nodes[node].action != Action::None) {
+            last_action = m_nodes[node].action;
+        }
+        return true;
+    });
+
+    // Something below is included, even if the directory itself is excluded.
+    if (matched_all && m_nodes[node].has_include) {
+        return true;
+    }
+    if (last_action != Action::None) {
+        return last_action == Action::Include;
+    }
+    return m_includes.empty();
+}
+
+bool ScanRules::is_excluded(std::string_view file_path) const noexcept {
+    const auto file_name = file_path.substr(file_path.find_last_of('/') + 1);
+    if (std::find(m_excluded_names.begin(), m_excluded_names.end(), file_name) != m_excluded_names.end()) {
+        return true;
+    }
+
+    std::uint32_t node{};
+    auto last_action = m_nodes[0].action;
+    for_each_component(file_path, [&](std::string_view component) {
+        node = find_child(node, component);
+        if (node == NO_NODE) {
+            return false;
+        }
+        if (m_nodes[node].action != Action::None) {
+            last_action = m_nodes[node].action;
+        }
+        return true;
+    });
+
+    if (last_action != Action::None) {
+        return last_action == Action::Exclude;
+    }
+    return !m_includes.empty();
+}
+
+std::vector<std::string> ScanRules::get_scan_roots() const noexcept {
+    const bool includes_all = std::any_of(m_includes.begin(), m_includes.end(), [](auto&& include) { return include.empty(); });
+    if (m_includes.empty() || includes_all) {
+        return {""};
+    }
+
+    // Skip includes nested into another one, they would be scanned twice.
+    std::vector<std::string> roots{};
+    for (auto&& include : m_includes) {
+        const bool is_nested = std::any_of(m_includes.begin(), m_includes.end(), [&include](auto&& other) {
+            return (include.size() > other.size() && include.starts_with(other) && include[other.size()] == '/');
+        });
+        const bool is_duplicate = std::find(roots.begin(), roots.end(), include) != roots.end();
+        if (!is_nested && !is_duplicate) {
+            roots.emplace_back(include);
+        }
+    }
+    return roots;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef SCAN_RULES_HPP
+#define SCAN_RULES_HPP
+
+#include <cstdint>      // for uint8_t, uint32_t
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <utility>      // for pair
+#include <vector>       // for vector
+
+// Include/exclude rules for scanning options, compiled into a prefix trie
+// over path components.
+//
+// Prefixes are option paths relative to SysctlOption::PROC_PATH, either
+// dotted (`net.ipv4`) or slashed (`net/ipv4`). Rule of the longest matching
+// prefix wins. If there is at least one include rule, everything outside of
+// included subtrees is excluded, and the scan starts only from included subtrees.
+class ScanRules final {
+ public:
+    ScanRules() noexcept;
+
+    // Rules matching the default view: `debug` and `dev` are excluded,
+    // as well as deprecated options.
+    static ScanRules default_rules() noexcept;
+
+    void add_include(std::string_view prefix) noexcept;
+    void add_exclude(std::string_view prefix) noexcept;
+
+    // Excludes options with given file name anywhere in the tree.
+    void add_excluded_name(std::string_view file_name) noexcept;
+
+    // Returns false, if no option below directory can be included,
+    // so it can be pruned before descending into it.
+    bool should_descend(std::string_view dir_path) const noexcept;
+
+    bool is_excluded(std::string_view file_path) const noexcept;
+
+    // Paths, from which the scan starts.
+    // Empty path stands for whole PROC_PATH.
+    std::vector<std::string> get_scan_roots() const noexcept;
+
+ private:
+    enum class Action : std::uint8_t {
+        None,
+        Include,
+        Exclude,
+    };
+
+    struct Node {
+        std::vector<std::pair<std::string, std::uint32_t>> children{};
+        Action action{Action::None};
+        // Node itself, or any node below it is included.
+        bool has_include{};
+    };
+
+    void add_rule(std::string_view prefix, Action action) noexcept;
+    std::uint32_t find_child(std::uint32_t node, std::string_view component) const noexcept;
+
+    std::vector<Node> m_nodes{};
+    std::vector<std::string> m_includes{};
+    std::vector<std::string> m_excluded_names{};
+};
+
+#endif  // SCAN_RULES_HPP
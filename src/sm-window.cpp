@@ -17,10 +17,14 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 
 #include "sm-window.hpp"
+#include "apply_transaction.hpp"
+#include "option_query.hpp"
 #include "sysctl_option.hpp"
 #include "utils.hpp"
 
-#include <thread>
+#include <algorithm>  // for min, max, find
+#include <memory>     // for make_shared, shared_ptr
+#include <optional>   // for optional
 
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -42,8 +46,16 @@
 
 #include <fmt/core.h>
 
+#include <QCheckBox>
+#include <QDateTime>
 #include <QDesktopServices>
+#include <QInputDialog>
 #include <QLineEdit>
+#include <QLocalSocket>
+#include <QMenu>
+#include <QMessageBox>
+#include <QPointer>
+#include <QSet>
 #include <QTemporaryFile>
 #include <QTextStream>
 #include <QTreeWidgetItem>
@@ -51,132 +63,106 @@
 
 namespace {
 
-auto generate_script_from_options(QTreeWidget* tree_options, std::span<QString> change_list) noexcept -> std::string {
-    std::string bash_script;
+// Sampling rate of pinned options, and rate at which their sparklines are redrawn.
+constexpr std::uint32_t SAMPLE_RATE_HZ     = 20;
+constexpr std::int32_t SAMPLE_REPAINT_MSEC = 100;
 
-    // Iterate through changed options,
-    // and generate cmd to apply changes.
-    for (auto&& option_name : change_list) {
-        const auto& items = tree_options->findItems(option_name, Qt::MatchExactly, TreeCol::Name);
-        /* clang-format off */
-        if (items.isEmpty()) { continue; }
-        /* clang-format on */
+// Values of loaded subtree are considered fresh for that long.
+constexpr qint64 SUBTREE_TTL_MSEC = 30000;
 
-        const auto& found_item = items.at(0);
+// Full option name of the option item.
+constexpr int OPTION_NAME_ROLE = Qt::UserRole;
+// Path of directory item, relative to SysctlOption::PROC_PATH.
+constexpr int DIR_PATH_ROLE = Qt::UserRole + 2;
+// Time, when children of directory item were loaded.
+constexpr int LOADED_AT_ROLE = Qt::UserRole + 3;
 
-        auto option_name_str = option_name.toStdString();
-        utils::replace_all(option_name_str, ".", "/");
-        option_name_str = fmt::format("{}/{}", SysctlOption::PROC_PATH, option_name_str);
+auto option_name_of(const QTreeWidgetItem* item) noexcept -> QString {
+    return item->data(TreeCol::Name, OPTION_NAME_ROLE).toString();
+}
 
-        auto bash_line = fmt::format("echo \"{}\" > {} && ", found_item->text(TreeCol::Value).toStdString(), option_name_str);
-        bash_script += bash_line;
-    }
+auto to_qstring(std::string_view str) noexcept -> QString {
+    return QString::fromUtf8(str.data(), static_cast<qsizetype>(str.size()));
+}
 
-    // Remove last occurencies of ' && '
-    if (bash_script.ends_with(" && ")) {
-        bash_script.erase(bash_script.size() - 4);
+// Last component of the path.
+auto base_name(std::string_view path) noexcept -> QString {
+    return to_qstring(path.substr(path.find_last_of('/') + 1));
+}
+
+// Hides directories without visible options, unless `filtering` is false.
+// Returns true, if any child of `parent` is visible.
+bool update_dir_visibility(QTreeWidgetItem* parent, bool filtering) noexcept {
+    bool any_visible{};
+    for (int i = 0; i < parent->childCount(); ++i) {
+        auto* child = parent->child(i);
+        if (child->data(TreeCol::Name, DIR_PATH_ROLE).isValid()) {
+            const bool has_visible = update_dir_visibility(child, filtering);
+            child->setHidden(filtering && !has_visible);
+        }
+        any_visible |= !child->isHidden();
     }
-    return bash_script;
+    return any_visible;
 }
 
-void init_options_tree_widget(QTreeWidget* tree_options, std::span<SysctlOption> options) noexcept {
-    for (auto&& sysctl_option : options) {
-        auto* widget_item = new QTreeWidgetItem(tree_options); // NOLINT
-        widget_item->setText(TreeCol::Name, sysctl_option.get_name().data());
-        widget_item->setText(TreeCol::Value, sysctl_option.get_value().data());
-        widget_item->setText(TreeCol::Displayed, QStringLiteral("true"));
-        widget_item->setFlags(widget_item->flags() | Qt::ItemIsEditable);
+auto format_apply_report(std::span<const ApplyResult> results) noexcept -> QString {
+    QString report;
+    for (auto&& result : results) {
+        switch (result.status) {
+        case ApplyStatus::Clamped:
+            report += QObject::tr("%1: requested '%2', kernel set '%3'\n").arg(QString::fromStdString(result.name), QString::fromStdString(result.requested), QString::fromStdString(result.actual));
+            break;
+        case ApplyStatus::Failed:
+            report += QObject::tr("%1: failed to set '%2'\n").arg(QString::fromStdString(result.name), QString::fromStdString(result.requested));
+            break;
+        case ApplyStatus::RolledBack:
+            report += QObject::tr("%1: rolled back to '%2'\n").arg(QString::fromStdString(result.name), QString::fromStdString(result.actual));
+            break;
+        default:
+            break;
+        }
     }
+    return report;
 }
 
 }  // namespace
 
-MainWindow::MainWindow(QWidget* parent)
-  : QMainWindow(parent) {
+MainWindow::MainWindow(ScanRules scan_rules, bool hierarchical, QWidget* parent)
+  : QMainWindow(parent), m_hierarchical(hierarchical), m_scan_rules(std::move(scan_rules)) {
     m_ui->setupUi(this);
 
     setAttribute(Qt::WA_NativeWindow);
     setWindowFlags(Qt::Window);  // for the close, min and max buttons
 
     m_ui->ok->setEnabled(false);
-
-    // Create worker thread
-    m_worker = new Work([&]() {
-        while (m_thread_running.load(std::memory_order_consume)) {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            fmt::print(stderr, "Waiting... \n");
-
-            m_cv.wait(lock, [&] { return m_running.load(std::memory_order_consume); });
-
-            if (m_running.load(std::memory_order_consume) && m_thread_running.load(std::memory_order_consume)) {
-                m_ui->ok->setEnabled(false);
-
-                const auto bash_script = generate_script_from_options(m_ui->treeOptions, std::span{m_change_list});
-                utils::runCmdTerminal(bash_script.c_str(), true);
-
-                // Convert to vector of std::string
-                std::vector<std::string> change_list(static_cast<std::size_t>(m_change_list.size()));
-                for (int i = 0; i < m_change_list.size(); ++i) {
-                    change_list[static_cast<std::size_t>(i)] = m_change_list[i].toStdString();
-                }
-
-                // Fetch new changes
-                m_options.clear();
-                m_options = SysctlOption::get_options();
-
-                // Go through change_list and remove changed ones
-                auto* tree_options = m_ui->treeOptions;
-                for (auto&& option_name : change_list) {
-                    if (auto result = ranges::find_if(m_options, [&option_name](auto&& option) { return option_name == option.get_name(); }); result != m_options.end()) {
-                        if (auto items = tree_options->findItems(QString{option_name.c_str()}, Qt::MatchExactly, TreeCol::Name); !items.isEmpty()) {
-                            const auto& item_value = items.at(0)->text(TreeCol::Value).toStdString();
-                            if (item_value == result->get_value()) {
-                                m_change_list.removeOne(QString{option_name.c_str()});
-                            }
-                        }
-                    }
-                }
-
-                // Reset state
-                m_running.store(false, std::memory_order_relaxed);
-                m_ui->ok->setEnabled(!m_change_list.isEmpty());
-            }
-        }
-    });
-
-    m_worker->moveToThread(m_worker_th);
-    // name to appear in ps, task manager, etc.
-    m_worker_th->setObjectName("WorkerThread");
+    m_ui->tree_view->setChecked(m_hierarchical);
+    m_journal.open(ApplyJournal::default_path());
+    m_ui->revert->setEnabled(m_journal.is_open());
+    m_clock.start();
 
     auto* tree_options = m_ui->treeOptions;
     QStringList column_names;
     column_names << "Name"
-                 << "Value";
+                 << "Value"
+                 << "Displayed"
+                 << "Immutable"
+                 << "Trend";
     tree_options->setHeaderLabels(column_names);
     tree_options->hideColumn(TreeCol::Displayed);  // Displayed status true/false
     tree_options->hideColumn(TreeCol::Immutable);  // Immutable status true/false
+    tree_options->setItemDelegateForColumn(TreeCol::Trend, new SparklineDelegate(m_sample_histories, tree_options));
     tree_options->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
 
     tree_options->setContextMenuPolicy(Qt::CustomContextMenu);
 
     tree_options->setEditTriggers(QTreeWidget::NoEditTriggers);
-    tree_options->blockSignals(true);
-
-    m_options = SysctlOption::get_options();
-
-    // TODO(vnepogodin): parallelize it
-    auto a2 = std::async(std::launch::deferred, [&] {
-        const std::lock_guard<std::mutex> guard(m_mutex);
-        init_options_tree_widget(tree_options, std::span{m_options});
-    });
 
     // Connect buttons signal
     connect(m_ui->cancel, &QPushButton::clicked, this, &MainWindow::on_cancel);
     connect(m_ui->ok, &QPushButton::clicked, this, &MainWindow::on_execute);
-
-    // Connect worker thread signals
-    connect(m_worker_th, &QThread::finished, m_worker, &QObject::deleteLater);
-    connect(m_worker_th, &QThread::started, m_worker, &Work::doHeavyCalculations, Qt::QueuedConnection);
+    connect(m_ui->revert, &QPushButton::clicked, this, &MainWindow::on_revert);
+    connect(m_ui->refresh, &QPushButton::clicked, this, &MainWindow::on_refresh);
+    connect(m_ui->tree_view, &QCheckBox::toggled, this, &MainWindow::set_hierarchical);
 
     // connect search box
     connect(m_ui->search_option, &QLineEdit::textChanged, this, &MainWindow::find_options);
@@ -184,17 +170,486 @@ MainWindow::MainWindow(QWidget* parent)
     // Connect tree widget
     connect(tree_options, &QTreeWidget::itemChanged, this, &MainWindow::item_changed);
     connect(tree_options, &QTreeWidget::itemDoubleClicked, this, &MainWindow::on_item_double_clicked);
+    connect(tree_options, &QTreeWidget::itemExpanded, this, &MainWindow::on_item_expanded);
+    connect(tree_options, &QTreeWidget::customContextMenuRequested, this, &MainWindow::on_context_menu);
 
-    // Wait for async function to finish
-    a2.wait();
-    tree_options->blockSignals(false);
+    connect(m_sample_timer, &QTimer::timeout, this, &MainWindow::on_sample_timer);
+
+    // Scan options in background, tree is filled once it's done.
+    on_refresh();
 }
 
 MainWindow::~MainWindow() {
-    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    if (m_worker_th != nullptr) {
-        m_worker_th->exit();
+    // Wait for running tasks, before anything they reference is destroyed.
+    m_scheduler.shutdown();
+}
+
+SysctlOption* MainWindow::find_option(const QString& option_name) noexcept {
+    const auto it = m_option_lookup.constFind(option_name);
+    return (it != m_option_lookup.cend()) ? &m_options[*it] : nullptr;
+}
+
+QTreeWidgetItem* MainWindow::find_option_item(const QString& option_name) noexcept {
+    const auto it = m_option_lookup.constFind(option_name);
+    return (it != m_option_lookup.cend()) ? m_option_items[*it] : nullptr;
+}
+
+QTreeWidgetItem* MainWindow::add_option(SysctlOption&& option, QTreeWidgetItem* parent) noexcept {
+    const auto& option_name = to_qstring(option.get_name());
+
+    auto* widget_item = new QTreeWidgetItem(parent);  // NOLINT
+    widget_item->setText(TreeCol::Name, m_hierarchical ? base_name(option.get_raw()) : option_name);
+    widget_item->setText(TreeCol::Value, to_qstring(option.get_value()));
+    widget_item->setText(TreeCol::Displayed, QStringLiteral("true"));
+    widget_item->setData(TreeCol::Name, OPTION_NAME_ROLE, option_name);
+    widget_item->setFlags(widget_item->flags() | Qt::ItemIsEditable);
+
+    m_option_lookup.insert(option_name, m_options.size());
+    m_options.emplace_back(std::move(option));
+    m_option_items.push_back(widget_item);
+
+    // Keep sampling option, which was pinned before the item was recreated.
+    if (const auto pinned_index = m_pinned_options.indexOf(option_name); pinned_index >= 0) {
+        widget_item->setData(TreeCol::Trend, SparklineDelegate::HISTORY_INDEX_ROLE, QVariant::fromValue(static_cast<std::size_t>(pinned_index)));
+    }
+
+    // Restore change, which was made before the item was recreated.
+    if (auto pending = m_pending_values.find(option_name); pending != m_pending_values.end()) {
+        widget_item->setText(TreeCol::Value, *pending);
+        m_pending_values.erase(pending);
+        build_changelist(widget_item);
+    }
+    return widget_item;
+}
+
+void MainWindow::clear_options() noexcept {
+    // Keep values, which user has changed, but not yet applied.
+    for (auto&& option_name : m_change_list) {
+        if (auto* item = find_option_item(option_name); item != nullptr) {
+            m_pending_values.insert(option_name, item->text(TreeCol::Value));
+        }
+    }
+    m_change_list.clear();
+
+    // Results of tasks started before are outdated now.
+    ++m_tree_generation;
+    reset_tree_scan();
+
+    m_ui->treeOptions->clear();
+    m_options.clear();
+    m_option_items.clear();
+    m_option_lookup.clear();
+    m_dir_items.clear();
+    m_tree_matches.clear();
+    m_search_expanded.clear();
+}
+
+void MainWindow::reset_tree_scan() noexcept {
+    m_tree_scan_stop.request_stop();
+    m_tree_scan.reset();
+    m_tree_scan_running = false;
+    ++m_tree_scan_serial;
+}
+
+void MainWindow::set_hierarchical(bool hierarchical) noexcept {
+    /* clang-format off */
+    if (m_hierarchical == hierarchical) { return; }
+    /* clang-format on */
+
+    // Scans of the other view are outdated, give their pool threads back.
+    m_refresh_stop.request_stop();
+    m_search_stop.request_stop();
+    m_ui->refresh->setEnabled(true);
+
+    auto* tree_options = m_ui->treeOptions;
+    tree_options->blockSignals(true);
+    clear_options();
+    tree_options->blockSignals(false);
+
+    m_hierarchical = hierarchical;
+    on_refresh();
+}
+
+void MainWindow::on_refresh() noexcept {
+    if (m_hierarchical) {
+        // Only directory names are listed up front, options are read on expand.
+        // Mark every loaded subtree as stale, and reload the ones user has expanded.
+        // Values searched before are stale too, next search scans the tree again.
+        reset_tree_scan();
+        for (auto&& dir_item : m_dir_items) {
+            dir_item->setData(TreeCol::Name, LOADED_AT_ROLE, QVariant{});
+        }
+        load_directory(QString{});
+        for (auto&& dir_item : m_dir_items) {
+            if (dir_item->isExpanded() && !m_search_expanded.contains(dir_item)) {
+                on_item_expanded(dir_item);
+            }
+        }
+        return;
+    }
+
+    m_ui->refresh->setEnabled(false);
+    m_refresh_stop.request_stop();
+    m_refresh_stop = run_task(
+        TaskPriority::Normal, [scan_rules = m_scan_rules](std::stop_token stoken) { return SysctlOption::get_options(scan_rules, stoken); },
+        [this, generation = m_tree_generation](std::vector<SysctlOption>&& options) {
+            m_ui->refresh->setEnabled(true);
+            /* clang-format off */
+            if (generation != m_tree_generation) { return; }
+            /* clang-format on */
+            on_options_loaded(std::move(options));
+        });
+}
+
+void MainWindow::on_options_loaded(std::vector<SysctlOption>&& options) noexcept {
+    auto* tree_options = m_ui->treeOptions;
+    tree_options->blockSignals(true);
+
+    clear_options();
+    m_options.reserve(options.size());
+    m_option_items.reserve(options.size());
+    for (auto&& option : options) {
+        add_option(std::move(option), tree_options->invisibleRootItem());
+    }
+    m_option_index = std::make_shared<const OptionIndex>(std::span{m_options});
+
+    tree_options->blockSignals(false);
+    m_ui->ok->setEnabled(!m_applying && !m_change_list.isEmpty());
+
+    // Items were recreated, mark pinned ones again.
+    restart_sampler();
+    find_options();
+}
+
+void MainWindow::load_directory(const QString& dir_path) noexcept {
+    run_task(
+        TaskPriority::Interactive,
+        [dir_path = dir_path.toStdString(), scan_rules = m_scan_rules](std::stop_token stoken) {
+            return SysctlOption::list_directory(dir_path, scan_rules, stoken);
+        },
+        [this, dir_path, generation = m_tree_generation](SysctlDirectory&& listing) {
+            /* clang-format off */
+            if (generation != m_tree_generation) { return; }
+            /* clang-format on */
+            on_directory_loaded(dir_path, std::move(listing));
+        });
+}
+
+void MainWindow::on_item_expanded(QTreeWidgetItem* item) noexcept {
+    const auto& dir_path = item->data(TreeCol::Name, DIR_PATH_ROLE);
+    /* clang-format off */
+    if (!dir_path.isValid()) { return; }
+    /* clang-format on */
+
+    // Expanded by user, it stays expanded after search.
+    m_search_expanded.removeAll(item);
+
+    const auto& loaded_at = item->data(TreeCol::Name, LOADED_AT_ROLE);
+    if (loaded_at.isValid() && (m_clock.elapsed() - loaded_at.toLongLong()) < SUBTREE_TTL_MSEC) {
+        return;
+    }
+
+    // Mark it right away, so it isn't loaded twice while the task is running.
+    m_ui->treeOptions->blockSignals(true);
+    item->setData(TreeCol::Name, LOADED_AT_ROLE, m_clock.elapsed());
+    m_ui->treeOptions->blockSignals(false);
+
+    load_directory(dir_path.toString());
+}
+
+QTreeWidgetItem* MainWindow::find_dir_item(const QString& dir_path) noexcept {
+    /* clang-format off */
+    if (dir_path.isEmpty()) { return m_ui->treeOptions->invisibleRootItem(); }
+    /* clang-format on */
+    if (auto* dir_item = m_dir_items.value(dir_path, nullptr); dir_item != nullptr) {
+        return dir_item;
+    }
+
+    // Parents are created as well, when search finds option in a directory not listed yet.
+    auto* parent_item = find_dir_item(dir_path.left(std::max(dir_path.lastIndexOf('/'), qsizetype{0})));
+
+    auto* dir_item = new QTreeWidgetItem(parent_item);  // NOLINT
+    dir_item->setText(TreeCol::Name, dir_path.section('/', -1));
+    dir_item->setData(TreeCol::Name, DIR_PATH_ROLE, dir_path);
+    dir_item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
+    m_dir_items.insert(dir_path, dir_item);
+    return dir_item;
+}
+
+void MainWindow::on_directory_loaded(const QString& dir_path, SysctlDirectory&& listing) noexcept {
+    auto* tree_options = m_ui->treeOptions;
+    auto* parent_item  = dir_path.isEmpty() ? tree_options->invisibleRootItem() : m_dir_items.value(dir_path, nullptr);
+    /* clang-format off */
+    if (parent_item == nullptr) { return; }
+    /* clang-format on */
+
+    tree_options->blockSignals(true);
+    for (auto&& subdir : listing.subdirs) {
+        find_dir_item(to_qstring(subdir));
+    }
+
+    for (auto&& option : listing.options) {
+        const auto& option_name = to_qstring(option.get_name());
+        auto* existing          = find_option(option_name);
+        if (existing == nullptr) {
+            add_option(std::move(option), parent_item);
+            continue;
+        }
+
+        // Subtree is reloaded, refresh values which user hasn't changed.
+        if (!m_change_list.contains(option_name)) {
+            find_option_item(option_name)->setText(TreeCol::Value, to_qstring(option.get_value()));
+        }
+        existing->set_value(std::string{option.get_value()});
+    }
+
+    if (!dir_path.isEmpty()) {
+        parent_item->setData(TreeCol::Name, LOADED_AT_ROLE, m_clock.elapsed());
+        if (parent_item->childCount() == 0) {
+            parent_item->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+        }
+    }
+    tree_options->blockSignals(false);
+
+    m_option_index = std::make_shared<const OptionIndex>(std::span{m_options});
+    m_ui->ok->setEnabled(!m_applying && !m_change_list.isEmpty());
+
+    // Tree search already knows every match, only filter the listed options.
+    if (m_hierarchical && !m_ui->search_option->text().trimmed().isEmpty()) {
+        apply_tree_matches();
+        return;
+    }
+    find_options();
+}
+
+bool MainWindow::listen_for_instances() noexcept {
+    const auto& server_name = instance_link::server_name();
+    m_instance_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_instance_server->listen(server_name)) {
+        // Socket might be left by crashed instance, never remove the one which is still served.
+        if (!instance_link::remove_stale_server() || !m_instance_server->listen(server_name)) {
+            fmt::print(stderr, "Failed to listen := '{}'\n", server_name.toStdString());
+            return false;
+        }
+    }
+    connect(m_instance_server, &QLocalServer::newConnection, this, &MainWindow::on_instance_connected);
+    return true;
+}
+
+void MainWindow::on_instance_connected() noexcept {
+    while (auto* socket = m_instance_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+
+        // Requests are handled once the empty line is received.
+        auto requests = std::make_shared<std::vector<instance_link::Request>>();
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket, requests] {
+            while (socket->canReadLine()) {
+                const auto& line = QString::fromUtf8(socket->readLine()).trimmed();
+                if (!line.isEmpty()) {
+                    if (auto request = instance_link::parse_request(line)) {
+                        requests->emplace_back(std::move(*request));
+                    }
+                    continue;
+                }
+                handle_instance_requests(socket, *requests);
+                requests->clear();
+            }
+        });
+    }
+}
+
+void MainWindow::handle_instance_requests(QLocalSocket* socket, std::span<const instance_link::Request> requests) noexcept {
+    QByteArray replies;
+    const auto add_reply = [&replies](const instance_link::Reply& reply) {
+        replies += instance_link::format_reply(reply).toUtf8();
+        replies += '\n';
+    };
+
+    std::vector<ApplyChange> changes;
+    bool is_revert{};
+    for (auto&& request : requests) {
+        std::string raw_path{};
+        QString option_name{};
+        // Only loaded options, or files under PROC_PATH, are touched.
+        bool is_option = instance_link::normalize_option(request.name, raw_path, option_name);
+        if (const auto* option = find_option(option_name); option != nullptr) {
+            raw_path  = option->get_raw();
+            is_option = true;
+        }
+
+        switch (request.kind) {
+        case instance_link::RequestKind::Raise:
+            setWindowState((windowState() & ~Qt::WindowMinimized) | Qt::WindowActive);
+            show();
+            raise();
+            activateWindow();
+            add_reply({.is_ok = true});
+            break;
+        case instance_link::RequestKind::Get:
+            add_reply(instance_link::make_get_reply(option_name, is_option ? refresh_option(option_name, raw_path) : std::nullopt));
+            break;
+        case instance_link::RequestKind::Set: {
+            auto old_value = is_option ? refresh_option(option_name, raw_path) : std::nullopt;
+            if (!old_value) {
+                add_reply(instance_link::make_get_reply(option_name, old_value));
+                break;
+            }
+            changes.emplace_back(ApplyChange{
+                .raw       = std::move(raw_path),
+                .name      = option_name.toStdString(),
+                .old_value = std::move(*old_value),
+                .new_value = request.value.toStdString()});
+            break;
+        }
+        case instance_link::RequestKind::RevertTo: {
+            const auto& revert_time = instance_link::parse_revert_time(requests);
+            if (!revert_time) {
+                add_reply({.is_ok = false, .text = tr("revert-to needs a time, and can't be combined with other requests")});
+                break;
+            }
+            changes = m_journal.revert_to(*revert_time);
+            if (changes.empty()) {
+                add_reply({.is_ok = true, .text = tr("options already have these values")});
+            }
+            is_revert = true;
+            break;
+        }
+        }
+    }
+
+    if (!changes.empty() && m_applying) {
+        if (is_revert) {
+            add_reply({.is_ok = false, .text = tr("another apply is running")});
+        } else {
+            for (auto&& change : changes) {
+                add_reply({.is_ok = false, .text = tr("%1: another apply is running").arg(QString::fromStdString(change.name))});
+            }
+        }
+        changes.clear();
+    }
+    if (changes.empty()) {
+        socket->write(replies);
+        socket->disconnectFromServer();
+        return;
+    }
+
+    // Sets are applied as one transaction, same as changes made in the tree.
+    // Socket might be gone by the time apply is done.
+    run_transaction(ApplyTransaction{std::move(changes)}, [socket = QPointer<QLocalSocket>(socket), replies, is_revert](std::span<const ApplyResult> results) mutable {
+        /* clang-format off */
+        if (!socket) { return; }
+        /* clang-format on */
+        if (is_revert) {
+            replies += instance_link::format_reply(instance_link::make_revert_reply(results)).toUtf8();
+            replies += '\n';
+        } else {
+            for (auto&& result : results) {
+                replies += instance_link::format_reply(instance_link::make_set_reply(result)).toUtf8();
+                replies += '\n';
+            }
+        }
+        socket->write(replies);
+        socket->disconnectFromServer();
+    });
+}
+
+std::optional<std::string> MainWindow::refresh_option(const QString& option_name, const std::string& raw_path) noexcept {
+    auto* option = find_option(option_name);
+    auto&& value = SysctlOption::read_value(option ? option->get_raw() : std::string_view{raw_path});
+    /* clang-format off */
+    if (!value || option == nullptr) { return value; }
+    /* clang-format on */
+
+    // Search index is rebuilt on next refresh, rebuilding it for every request would cost more than the read.
+    if (*value != option->get_value()) {
+        option->set_value(std::string{*value});
+        if (auto* item = find_option_item(option_name); item != nullptr && !m_change_list.contains(option_name)) {
+            m_ui->treeOptions->blockSignals(true);
+            item->setText(TreeCol::Value, QString::fromStdString(*value));
+            m_ui->treeOptions->blockSignals(false);
+        }
     }
+    return value;
+}
+
+void MainWindow::on_context_menu(const QPoint& pos) noexcept {
+    auto* item = m_ui->treeOptions->itemAt(pos);
+    /* clang-format off */
+    if (item == nullptr) { return; }
+    /* clang-format on */
+
+    const auto& option_name = option_name_of(item);
+    /* clang-format off */
+    if (option_name.isEmpty()) { return; }
+    /* clang-format on */
+    const bool is_pinned = m_pinned_options.contains(option_name);
+
+    QMenu menu(this);
+    auto* pin_action = menu.addAction(is_pinned ? tr("Stop sampling") : tr("Sample value"));
+    if (menu.exec(m_ui->treeOptions->viewport()->mapToGlobal(pos)) != pin_action) {
+        return;
+    }
+
+    if (is_pinned) {
+        m_pinned_options.removeAll(option_name);
+    } else {
+        m_pinned_options.append(option_name);
+    }
+    restart_sampler();
+}
+
+void MainWindow::restart_sampler() noexcept {
+    m_sample_timer->stop();
+    m_sampler.reset();
+
+    auto* tree_options = m_ui->treeOptions;
+    tree_options->blockSignals(true);
+
+    // Unmark previously sampled items.
+    for (auto* item : m_option_items) {
+        item->setData(TreeCol::Trend, SparklineDelegate::HISTORY_INDEX_ROLE, QVariant{});
+    }
+
+    // Sampler key index is the index in the pinned list,
+    // drop options which are gone.
+    std::vector<std::string> raw_paths{};
+    for (auto it = m_pinned_options.begin(); it != m_pinned_options.end();) {
+        auto* option = find_option(*it);
+        auto* item   = find_option_item(*it);
+        if (option == nullptr || item == nullptr) {
+            it = m_pinned_options.erase(it);
+            continue;
+        }
+        item->setData(TreeCol::Trend, SparklineDelegate::HISTORY_INDEX_ROLE, QVariant::fromValue(raw_paths.size()));
+        raw_paths.emplace_back(option->get_raw());
+        ++it;
+    }
+    tree_options->blockSignals(false);
+
+    m_sample_histories.assign(raw_paths.size(), SampleHistory{});
+    /* clang-format off */
+    if (raw_paths.empty()) { return; }
+    /* clang-format on */
+
+    m_sampler = std::make_unique<OptionSampler>(std::span{raw_paths}, SAMPLE_RATE_HZ);
+    if (!m_sampler->start()) {
+        m_sampler.reset();
+        return;
+    }
+    m_sample_timer->start(SAMPLE_REPAINT_MSEC);
+}
+
+void MainWindow::on_sample_timer() noexcept {
+    /* clang-format off */
+    if (!m_sampler) { return; }
+    /* clang-format on */
+
+    m_sampler->drain([this](const OptionSample& sample) {
+        if (sample.key_index < m_sample_histories.size()) {
+            m_sample_histories[sample.key_index].push(sample.value);
+        }
+    });
+    m_ui->treeOptions->viewport()->update();
 }
 
 // Find package in view
@@ -204,17 +659,179 @@ void MainWindow::find_options() noexcept {
     if (word.length() == 1) { return; }
     /* clang-format on */
 
+    std::string error{};
+    auto query = OptionQuery::compile(word.toStdString(), error);
+    m_ui->search_option->setToolTip(QString::fromStdString(error));
+    /* clang-format off */
+    if (!query) { return; }
+    /* clang-format on */
+
+    // Flag options with pending changes, for `changed:` term.
+    std::vector<std::uint8_t> changed(m_options.size());
+    for (auto&& option_name : m_change_list) {
+        if (const auto it = m_option_lookup.constFind(option_name); it != m_option_lookup.cend()) {
+            changed[*it] = 1;
+        }
+    }
+
+    // Drop previous search, it's outdated now.
+    m_search_stop.request_stop();
+
+    // Most options of the tree are not loaded, so search covers all of them.
+    if (m_hierarchical && !word.trimmed().isEmpty()) {
+        find_options_in_tree(std::move(*query));
+        return;
+    }
+
+    m_search_stop = run_task(
+        TaskPriority::Interactive,
+        [option_index = m_option_index, query = std::move(*query), changed = std::move(changed)](std::stop_token stoken) {
+            return std::make_pair(option_index, query.match(*option_index, changed, stoken));
+        },
+        [this](auto&& search_result) {
+            auto&& [option_index, matched] = search_result;
+            // Options were rescanned in the meantime.
+            /* clang-format off */
+            if (option_index != m_option_index) { return; }
+            /* clang-format on */
+
+            const auto items_count = std::min(m_option_items.size(), matched.size());
+            for (std::size_t i = 0; i < items_count; ++i) {
+                auto* item = m_option_items[i];
+                item->setHidden(item->text(TreeCol::Displayed) != QLatin1String("true") || !matched[i]);
+            }
+            // Empty search, show all directories of the tree again.
+            if (m_hierarchical) {
+                m_ui->treeOptions->blockSignals(true);
+                collapse_search_expanded();
+                m_tree_matches.clear();
+                update_dir_visibility(m_ui->treeOptions->invisibleRootItem(), false);
+                m_ui->treeOptions->blockSignals(false);
+            }
+
+            auto* tree_options = m_ui->treeOptions;
+            for (int i = 0; i < tree_options->columnCount(); ++i) {
+                tree_options->resizeColumnToContents(i);
+            }
+        });
+}
+
+void MainWindow::find_options_in_tree(OptionQuery&& query) noexcept {
+    // Tree is scanned once, searches reuse the scan until it's refreshed.
+    if (!m_tree_scan) {
+        /* clang-format off */
+        if (m_tree_scan_running) { return; }
+        /* clang-format on */
+        m_tree_scan_running = true;
+        m_tree_scan_stop    = run_task(
+            TaskPriority::Interactive,
+            [scan_rules = m_scan_rules](std::stop_token stoken) {
+                return std::make_shared<const TreeScan>(SysctlOption::get_options(scan_rules, stoken));
+            },
+            [this, serial = m_tree_scan_serial](std::shared_ptr<const TreeScan>&& tree_scan) {
+                /* clang-format off */
+                if (serial != m_tree_scan_serial) { return; }
+                /* clang-format on */
+                m_tree_scan         = std::move(tree_scan);
+                m_tree_scan_running = false;
+                // Search with the query typed by now.
+                find_options();
+            });
+        return;
+    }
+
+    // Flag by name, most options have no index yet.
+    std::vector<std::string> changed_names{};
+    for (auto&& option_name : m_change_list) {
+        changed_names.emplace_back(option_name.toStdString());
+    }
+
+    m_search_stop = run_task(
+        TaskPriority::Interactive,
+        [tree_scan = m_tree_scan, query = std::move(query), changed_names = std::move(changed_names)](std::stop_token stoken) {
+            const auto& options = tree_scan->options;
+            std::vector<std::uint8_t> changed(options.size());
+            for (std::size_t i = 0; i < options.size(); ++i) {
+                const bool is_changed = std::find(changed_names.begin(), changed_names.end(), options[i].get_name()) != changed_names.end();
+                changed[i]            = is_changed ? 1 : 0;
+            }
+            return std::make_pair(tree_scan, query.match(tree_scan->index, changed, stoken));
+        },
+        [this](auto&& search_result) {
+            auto&& [tree_scan, matched] = search_result;
+            // Tree was refreshed in the meantime.
+            /* clang-format off */
+            if (tree_scan != m_tree_scan) { return; }
+            /* clang-format on */
+            on_tree_search_finished(*tree_scan, matched);
+        });
+}
+
+void MainWindow::on_tree_search_finished(const TreeScan& tree_scan, const std::vector<bool>& matched) noexcept {
     auto* tree_options = m_ui->treeOptions;
-    auto found_items   = tree_options->findItems(word, Qt::MatchContains, TreeCol::Name);
+    tree_options->blockSignals(true);
+
+    // Matches of the previous search might be gone.
+    collapse_search_expanded();
 
-    for (QTreeWidgetItemIterator it(tree_options); *it; ++it) {
-        (*it)->setHidden((*it)->text(TreeCol::Displayed) != QLatin1String("true") || !found_items.contains(*it));
+    // Load matches into their directories, already loaded ones keep their values.
+    m_tree_matches.clear();
+    bool has_added{};
+    for (std::size_t i = 0; i < matched.size(); ++i) {
+        /* clang-format off */
+        if (!matched[i]) { continue; }
+        /* clang-format on */
+
+        const auto& option      = tree_scan.options[i];
+        const auto& option_name = to_qstring(option.get_name());
+        m_tree_matches.insert(option_name);
+
+        const auto raw_path  = option.get_raw();
+        const auto slash_pos = raw_path.find_last_of('/');
+        const auto& dir_path = (slash_pos == std::string_view::npos) ? QString{} : to_qstring(raw_path.substr(0, slash_pos));
+        auto* dir_item       = find_dir_item(dir_path);
+        if (find_option(option_name) == nullptr) {
+            add_option(SysctlOption{option}, dir_item);
+            has_added = true;
+        }
+
+        // Show matches without expanding directories by hand.
+        // Directories created by search are not loaded, they are listed fully once expanded again.
+        // Top level directories have no parent item, options at root have no directory.
+        auto* parent_item = (dir_item != tree_options->invisibleRootItem()) ? dir_item : nullptr;
+        for (; parent_item != nullptr && !parent_item->isExpanded(); parent_item = parent_item->parent()) {
+            parent_item->setExpanded(true);
+            m_search_expanded.append(parent_item);
+        }
+    }
+    tree_options->blockSignals(false);
+    apply_tree_matches();
+
+    if (has_added) {
+        m_option_index = std::make_shared<const OptionIndex>(std::span{m_options});
     }
     for (int i = 0; i < tree_options->columnCount(); ++i) {
         tree_options->resizeColumnToContents(i);
     }
 }
 
+void MainWindow::apply_tree_matches() noexcept {
+    auto* tree_options = m_ui->treeOptions;
+    tree_options->blockSignals(true);
+    for (auto* item : m_option_items) {
+        item->setHidden(item->text(TreeCol::Displayed) != QLatin1String("true") || !m_tree_matches.contains(option_name_of(item)));
+    }
+    update_dir_visibility(tree_options->invisibleRootItem(), true);
+    tree_options->blockSignals(false);
+}
+
+void MainWindow::collapse_search_expanded() noexcept {
+    for (auto* dir_item : m_search_expanded) {
+        dir_item->setExpanded(false);
+    }
+    m_search_expanded.clear();
+}
+
 // When double-clicking on value column
 void MainWindow::on_item_double_clicked(QTreeWidgetItem* item, int column) noexcept {
     switch (column) {
@@ -222,9 +839,8 @@ void MainWindow::on_item_double_clicked(QTreeWidgetItem* item, int column) noexc
         m_ui->treeOptions->editItem(item, column);
         break;
     case TreeCol::Name: {
-        auto&& item_name = item->text(TreeCol::Name).toStdString();
-        if (auto result = ranges::find_if(m_options, [item_name = std::move(item_name)](auto&& option) { return item_name == option.get_name(); }); result != m_options.end()) {
-            QDesktopServices::openUrl(QUrl(result->get_doc().data()));
+        if (const auto* option = find_option(option_name_of(item)); option != nullptr) {
+            QDesktopServices::openUrl(QUrl(option->get_doc().data()));
         }
         break;
     }
@@ -241,22 +857,16 @@ void MainWindow::item_changed(QTreeWidgetItem* item, int) noexcept {
 // Build the change_list when selecting on item in the tree
 void MainWindow::build_changelist(QTreeWidgetItem* item) noexcept {
     const auto& item_value = item->text(TreeCol::Value);
-    const auto& item_name  = item->text(TreeCol::Name);
+    const auto& item_name  = option_name_of(item);
 
-    for (auto&& sysctl_option : m_options) {
-        /* clang-format off */
-        if (item_name != sysctl_option.get_name().data()) { continue; }
-        /* clang-format on */
-
-        if (item_value != sysctl_option.get_value().data()) {
+    if (const auto* sysctl_option = find_option(item_name); sysctl_option != nullptr) {
+        if (item_value != to_qstring(sysctl_option->get_value())) {
             m_ui->ok->setEnabled(true);
             m_change_list.append(item_name);
             return;
         }
-        if (item_value == sysctl_option.get_value().data()) {
-            m_change_list.removeOne(item_name);
-            return;
-        }
+        m_change_list.removeOne(item_name);
+        return;
     }
 
     if (m_change_list.isEmpty()) {
@@ -264,11 +874,68 @@ void MainWindow::build_changelist(QTreeWidgetItem* item) noexcept {
     }
 }
 
+auto MainWindow::collect_changes() noexcept -> std::vector<ApplyChange> {
+    std::vector<ApplyChange> changes;
+    changes.reserve(static_cast<std::size_t>(m_change_list.size()));
+
+    // Collect changed options, together with new values entered by user.
+    // Old values are read again by the transaction.
+    for (auto&& option_name : m_change_list) {
+        const auto* option = find_option(option_name);
+        const auto* item   = find_option_item(option_name);
+        /* clang-format off */
+        if (option == nullptr || item == nullptr) { continue; }
+        /* clang-format on */
+
+        auto&& option_name_str = option_name.toStdString();
+        if (ranges::find_if(changes, [&option_name_str](auto&& change) { return change.name == option_name_str; }) != changes.end()) {
+            continue;
+        }
+
+        changes.emplace_back(ApplyChange{
+            .raw       = std::string{option->get_raw()},
+            .name      = std::move(option_name_str),
+            .old_value = std::string{option->get_value()},
+            .new_value = item->text(TreeCol::Value).toStdString()});
+    }
+    return changes;
+}
+
+void MainWindow::on_apply_finished(std::span<const ApplyResult> results) noexcept {
+    auto* tree_options = m_ui->treeOptions;
+    tree_options->blockSignals(true);
+
+    for (auto&& result : results) {
+        const auto& option_name = QString::fromStdString(result.name);
+        if (auto* option = find_option(option_name); option != nullptr && result.status != ApplyStatus::Failed) {
+            option->set_value(std::string{result.actual});
+        }
+
+        if (result.status == ApplyStatus::Applied || result.status == ApplyStatus::Clamped) {
+            m_change_list.removeAll(option_name);
+        }
+        // Show value which kernel actually stored, reverted options weren't edited in the tree.
+        if (result.status == ApplyStatus::Applied || result.status == ApplyStatus::Clamped) {
+            if (auto* item = find_option_item(option_name); item != nullptr) {
+                item->setText(TreeCol::Value, QString::fromStdString(result.actual));
+            }
+        }
+    }
+
+    tree_options->blockSignals(false);
+    m_ui->ok->setEnabled(!m_change_list.isEmpty());
+
+    // Values have changed, so value predicates of the search see them.
+    m_option_index = std::make_shared<const OptionIndex>(std::span{m_options});
+
+    if (const auto& report = format_apply_report(results); !report.isEmpty()) {
+        QMessageBox::warning(this, tr("Apply"), report);
+    }
+}
+
 void MainWindow::closeEvent(QCloseEvent* event) {
-    // Exit worker thread
-    m_running.store(true, std::memory_order_relaxed);
-    m_thread_running.store(false, std::memory_order_relaxed);
-    m_cv.notify_all();
+    // Stop running tasks
+    m_scheduler.cancel_all();
 
     // Execute parent function
     QWidget::closeEvent(event);
@@ -278,16 +945,72 @@ void MainWindow::on_cancel() noexcept {
     close();
 }
 
-void Work::doHeavyCalculations() {
-    m_func();
+void MainWindow::on_execute() noexcept {
+    if (m_applying) {
+        return;
+    }
+
+    // Snapshot changes on GUI thread, worker doesn't touch widgets.
+    run_transaction(ApplyTransaction{collect_changes()});
 }
 
-void MainWindow::on_execute() noexcept {
-    if (m_running.load(std::memory_order_consume)) {
+void MainWindow::on_revert() noexcept {
+    if (m_applying) {
         return;
     }
-    m_running.store(true, std::memory_order_relaxed);
-    m_thread_running.store(true, std::memory_order_relaxed);
-    m_cv.notify_all();
-    m_worker_th->start();
+
+    const auto records = m_journal.get_records();
+    if (records.empty()) {
+        QMessageBox::information(this, tr("Revert"), tr("Nothing has been applied yet."));
+        return;
+    }
+
+    // Newest apply goes first, choosing one reverts it together with all newer ones.
+    QStringList record_names;
+    for (auto it = records.rbegin(); it != records.rend(); ++it) {
+        const auto& applied_at = QDateTime::fromSecsSinceEpoch(it->timestamp).toString(Qt::ISODate);
+        record_names << tr("%1. %2: %n option(s)", nullptr, static_cast<int>(it->change_count)).arg(record_names.size() + 1).arg(applied_at);
+    }
+
+    bool is_accepted{};
+    const auto& chosen = QInputDialog::getItem(this, tr("Revert"), tr("Revert applies back to, and including:"), record_names, 0, false, &is_accepted);
+    /* clang-format off */
+    if (!is_accepted) { return; }
+    /* clang-format on */
+
+    auto changes = m_journal.revert_last(static_cast<std::size_t>(record_names.indexOf(chosen)) + 1);
+    if (changes.empty()) {
+        QMessageBox::information(this, tr("Revert"), tr("Options already have these values."));
+        return;
+    }
+    run_transaction(ApplyTransaction{std::move(changes)});
+}
+
+void MainWindow::run_transaction(ApplyTransaction&& transaction, std::function<void(std::span<const ApplyResult>)> on_done) noexcept {
+    /* clang-format off */
+    if (transaction.empty()) { return; }
+    /* clang-format on */
+
+    m_applying = true;
+    m_ui->ok->setEnabled(false);
+    m_ui->revert->setEnabled(false);
+
+    run_task(
+        TaskPriority::Normal,
+        [transaction = std::move(transaction), journal = &m_journal](std::stop_token) {
+            auto results = transaction.execute([](auto&& script) { utils::runCmdTerminal(script.c_str(), true); });
+
+            // Record it right away, values were changed even if the window is closed
+            // in the meantime, and the result never reaches the GUI thread.
+            journal->append(transaction.get_changes(), results);
+            return results;
+        },
+        [this, on_done = std::move(on_done)](auto&& results) {
+            m_applying = false;
+            m_ui->revert->setEnabled(m_journal.is_open());
+            if (on_done) {
+                on_done(results);
+            }
+            on_apply_finished(results);
+        });
 }
@@ -36,17 +36,32 @@
 
 #include <ui_sm-window.h>
 
+#include "apply_journal.hpp"
+#include "apply_transaction.hpp"
+#include "instance_link.hpp"
+#include "option_query.hpp"
+#include "option_sampler.hpp"
+#include "sparkline_delegate.hpp"
 #include "sysctl_option.hpp"
+#include "task_scheduler.hpp"
 #include "utils.hpp"
 
 #include <array>
-#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <memory>
-#include <thread>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QLocalServer>
 #include <QMainWindow>
-#include <QThread>
+#include <QSet>
+#include <QTimer>
 
 #if defined(__clang__)
 #pragma clang diagnostic pop
@@ -54,59 +69,135 @@
 #pragma GCC diagnostic pop
 #endif
 
-class Work final : public QObject {
-    Q_OBJECT
-
- public:
-    using function_t = std::function<void()>;
-    explicit Work(function_t func)
-      : m_func(func) { }
-    virtual ~Work() = default;
-
- public:
-    void doHeavyCalculations();
-
- private:
-    function_t m_func;
-};
-
 namespace TreeCol {
 enum { Name,
     Value,
     Displayed,
-    Immutable };
+    Immutable,
+    Trend };
 }
 
 class MainWindow final : public QMainWindow {
     Q_OBJECT
     Q_DISABLE_COPY_MOVE(MainWindow)
  public:
-    explicit MainWindow(QWidget* parent = nullptr);
+    explicit MainWindow(ScanRules scan_rules = ScanRules::default_rules(), bool hierarchical = false, QWidget* parent = nullptr);
     virtual ~MainWindow();
 
+    // Accepts requests of later launches, instead of them starting a new instance.
+    bool listen_for_instances() noexcept;
+
  protected:
     void closeEvent(QCloseEvent* event) override;
 
  private:
-    std::atomic_bool m_running{};
-    std::atomic_bool m_thread_running{true};
-    std::mutex m_mutex{};
-    std::condition_variable m_cv{};
+    bool m_applying{};
+    // Options are grouped by directories, which are loaded on expand.
+    bool m_hierarchical{};
 
     QStringList m_change_list{};
 
-    QThread* m_worker_th = new QThread(this);
-    Work* m_worker{nullptr};
-
     std::unique_ptr<Ui::MainWindow> m_ui = std::make_unique<Ui::MainWindow>();
     std::vector<SysctlOption> m_options{};
+    // Tree items of loaded options, parallel to `m_options`.
+    std::vector<QTreeWidgetItem*> m_option_items{};
+    QHash<QString, std::size_t> m_option_lookup{};
+    QHash<QString, QTreeWidgetItem*> m_dir_items{};
+    // Values entered by user, for options which are not loaded (yet).
+    QHash<QString, QString> m_pending_values{};
+    QElapsedTimer m_clock{};
+    // Bumped whenever the tree is cleared, so results of older tasks are dropped.
+    std::uint64_t m_tree_generation{};
+    ScanRules m_scan_rules{};
+    // Immutable snapshot of option names and values, shared with search tasks.
+    std::shared_ptr<const OptionIndex> m_option_index = std::make_shared<const OptionIndex>(std::span<const SysctlOption>{});
+
+    // Full scan of the tree, searched on every keystroke until the tree is refreshed.
+    struct TreeScan {
+        explicit TreeScan(std::vector<SysctlOption>&& scanned) noexcept
+          : options(std::move(scanned)), index(options) { }
+
+        std::vector<SysctlOption> options{};
+        OptionIndex index;
+    };
+    std::shared_ptr<const TreeScan> m_tree_scan{};
+    bool m_tree_scan_running{};
+    // Bumped whenever the scan is dropped, so result of a running scan is dropped too.
+    std::uint64_t m_tree_scan_serial{};
+    std::stop_source m_tree_scan_stop{};
+    // Options matched by the last tree search, directories loaded afterwards are filtered with them.
+    QSet<QString> m_tree_matches{};
+    // Directories expanded only to show search matches, they are collapsed once the search changes.
+    QList<QTreeWidgetItem*> m_search_expanded{};
+
+    // Options pinned for sampling, and their sampled history.
+    QStringList m_pinned_options{};
+    std::vector<SampleHistory> m_sample_histories{};
+    std::unique_ptr<OptionSampler> m_sampler{};
+    QTimer* m_sample_timer = new QTimer(this);
+
+    // Applied change sets, for revert.
+    ApplyJournal m_journal{};
+
+    QLocalServer* m_instance_server = new QLocalServer(this);
+
+    TaskScheduler m_scheduler{};
+    std::stop_source m_search_stop{};
+    std::stop_source m_refresh_stop{};
+
+    // Runs `work` on the scheduler, and passes its result to `done` on the GUI thread.
+    // Result of cancelled task is dropped.
+    template <typename Work, typename Done>
+    std::stop_source run_task(TaskPriority priority, Work&& work, Done&& done) noexcept {
+        return m_scheduler.submit(priority, [this, work = std::forward<Work>(work), done = std::forward<Done>(done)](std::stop_token stoken) {
+            auto&& result = work(stoken);
+            /* clang-format off */
+            if (stoken.stop_requested()) { return; }
+            /* clang-format on */
+            QMetaObject::invokeMethod(
+                this, [done, result = std::move(result)]() mutable { done(std::move(result)); }, Qt::QueuedConnection);
+        });
+    }
+
+    SysctlOption* find_option(const QString& option_name) noexcept;
+    QTreeWidgetItem* find_option_item(const QString& option_name) noexcept;
+    QTreeWidgetItem* add_option(SysctlOption&& option, QTreeWidgetItem* parent) noexcept;
+    void clear_options() noexcept;
 
     void build_changelist(QTreeWidgetItem* item) noexcept;
+    auto collect_changes() noexcept -> std::vector<ApplyChange>;
 
     void on_cancel() noexcept;
     void on_execute() noexcept;
+    void on_revert() noexcept;
+    void on_refresh() noexcept;
+    void on_options_loaded(std::vector<SysctlOption>&& options) noexcept;
+    void set_hierarchical(bool hierarchical) noexcept;
+    void load_directory(const QString& dir_path) noexcept;
+    void on_directory_loaded(const QString& dir_path, SysctlDirectory&& listing) noexcept;
+    void on_item_expanded(QTreeWidgetItem* item) noexcept;
+    // Returns item of the directory, creating it with its parents if needed.
+    QTreeWidgetItem* find_dir_item(const QString& dir_path) noexcept;
+    // `on_done` is called with results, before they are shown.
+    void run_transaction(ApplyTransaction&& transaction, std::function<void(std::span<const ApplyResult>)> on_done = {}) noexcept;
+    void on_apply_finished(std::span<const ApplyResult> results) noexcept;
 
     void find_options() noexcept;
+    void find_options_in_tree(OptionQuery&& query) noexcept;
+    void on_tree_search_finished(const TreeScan& tree_scan, const std::vector<bool>& matched) noexcept;
+    // Hides options, which the last tree search didn't match.
+    void apply_tree_matches() noexcept;
+    void collapse_search_expanded() noexcept;
+    void reset_tree_scan() noexcept;
+
+    void on_instance_connected() noexcept;
+    void handle_instance_requests(QLocalSocket* socket, std::span<const instance_link::Request> requests) noexcept;
+    // Reads current value of single option, and updates the table with it.
+    std::optional<std::string> refresh_option(const QString& option_name, const std::string& raw_path) noexcept;
+
+    void on_context_menu(const QPoint& pos) noexcept;
+    void restart_sampler() noexcept;
+    void on_sample_timer() noexcept;
 
     void on_item_double_clicked(QTreeWidgetItem* item, int column) noexcept;
     void item_changed(QTreeWidgetItem* item, int column) noexcept;
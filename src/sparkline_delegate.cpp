@@ -0,0 +1,85 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "sparkline_delegate.hpp"
+
+#include <QApplication>
+#include <QPainter>
+#include <QPolygonF>
+
+namespace {
+
+constexpr int SPARKLINE_WIDTH = 160;
+constexpr qreal SPARKLINE_PAD = 2.0;
+
+}  // namespace
+
+void SparklineDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    const auto& history_index = index.data(HISTORY_INDEX_ROLE);
+    if (!history_index.isValid() || history_index.toULongLong() >= m_histories.size()) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    // Paint selection and background as usual.
+    const auto* style = (option.widget != nullptr) ? option.widget->style() : QApplication::style();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &option, painter, option.widget);
+
+    const auto& history = m_histories[history_index.toULongLong()];
+    /* clang-format off */
+    if (history.size == 0) { return; }
+    /* clang-format on */
+
+    auto min_value = history.at(0);
+    auto max_value = history.at(0);
+    for (std::size_t i = 1; i < history.size; ++i) {
+        min_value = std::min(min_value, history.at(i));
+        max_value = std::max(max_value, history.at(i));
+    }
+
+    const auto& rect   = QRectF(option.rect).adjusted(SPARKLINE_PAD, SPARKLINE_PAD, -SPARKLINE_PAD, -SPARKLINE_PAD);
+    const auto range   = (max_value - min_value).to_double();
+    const auto x_step  = rect.width() / static_cast<qreal>(SampleHistory::CAPACITY - 1);
+    const auto x_start = rect.right() - x_step * static_cast<qreal>(history.size - 1);
+
+    QPolygonF points;
+    points.reserve(static_cast<qsizetype>(history.size));
+    for (std::size_t i = 0; i < history.size; ++i) {
+        // Flat line in the middle, if value didn't change.
+        const auto ratio = (range > 0) ? (history.at(i) - min_value).to_double() / range : 0.5;
+        points << QPointF(x_start + x_step * static_cast<qreal>(i), rect.bottom() - ratio * rect.height());
+    }
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(option.palette.color((option.state & QStyle::State_Selected) ? QPalette::HighlightedText : QPalette::Highlight));
+    painter->drawPolyline(points);
+
+    // Latest value, tree keeps the value from the last scan.
+    painter->setPen(option.palette.color((option.state & QStyle::State_Selected) ? QPalette::HighlightedText : QPalette::Text));
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, QString::fromStdString(history.at(history.size - 1).to_string()));
+    painter->restore();
+}
+
+QSize SparklineDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    auto size_hint = QStyledItemDelegate::sizeHint(option, index);
+    if (index.data(HISTORY_INDEX_ROLE).isValid()) {
+        size_hint.setWidth(std::max(size_hint.width(), SPARKLINE_WIDTH));
+    }
+    return size_hint;
+}
@@ -0,0 +1,66 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef SPARKLINE_DELEGATE_HPP
+#define SPARKLINE_DELEGATE_HPP
+
+#include "option_number.hpp"
+
+#include <algorithm>  // for min
+#include <array>      // for array
+#include <vector>     // for vector
+
+#include <QStyledItemDelegate>
+
+// Fixed size history of sampled values.
+struct SampleHistory {
+    static constexpr std::size_t CAPACITY = 128;
+
+    std::array<OptionNumber, CAPACITY> values{};
+    std::size_t head{};
+    std::size_t size{};
+
+    void push(const OptionNumber& value) noexcept {
+        values[head] = value;
+        head         = (head + 1) % CAPACITY;
+        size         = std::min(size + 1, CAPACITY);
+    }
+
+    // Returns i-th value, starting from the oldest one.
+    const OptionNumber& at(std::size_t index) const noexcept {
+        return values[(head + CAPACITY - size + index) % CAPACITY];
+    }
+};
+
+// Paints sparkline of the sample history, which index is stored in the item
+// under `HISTORY_INDEX_ROLE`. Items without it are painted as usual.
+class SparklineDelegate final : public QStyledItemDelegate {
+ public:
+    static constexpr int HISTORY_INDEX_ROLE = Qt::UserRole + 1;
+
+    explicit SparklineDelegate(const std::vector<SampleHistory>& histories, QObject* parent = nullptr)
+      : QStyledItemDelegate(parent), m_histories(histories) { }
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+ private:
+    const std::vector<SampleHistory>& m_histories;
+};
+
+#endif  // SPARKLINE_DELEGATE_HPP
@@ -0,0 +1,64 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <array>    // for array
+#include <atomic>   // for atomic
+#include <cstddef>  // for size_t
+
+// Lock-free ring buffer for exactly one producer and one consumer thread.
+// Storage is fixed, no allocations are made after construction.
+template <typename T, std::size_t Capacity>
+class SpscRing final {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+    // Returns false if the ring is full, value is dropped then.
+    bool try_push(const T& value) noexcept {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_buffer[tail & MASK] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) noexcept {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_buffer[head & MASK];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+ private:
+    static constexpr std::size_t MASK       = Capacity - 1;
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    // Keep indices on separate cache lines, to avoid false sharing.
+    alignas(CACHE_LINE) std::atomic<std::size_t> m_head{};
+    alignas(CACHE_LINE) std::atomic<std::size_t> m_tail{};
+    alignas(CACHE_LINE) std::array<T, Capacity> m_buffer{};
+};
+
+#endif  // SPSC_RING_HPP
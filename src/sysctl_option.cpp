@@ -19,42 +19,21 @@
 #include "sysctl_option.hpp"
 #include "utils.hpp"
 
-#include <array>       // for array
-#include <filesystem>  // for recursive_directory_iterator, is_directory
-#include <fstream>     // for ifstream
-#include <string>      // for string
+#include <algorithm>     // for sort, min
+#include <filesystem>    // for recursive_directory_iterator, directory_entry, canonical
+#include <fstream>       // for ifstream
+#include <optional>      // for optional
+#include <string>        // for string
+#include <system_error>  // for error_code
 
 #include <fmt/core.h>
 
-#if defined(__clang__)
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wold-style-cast"
-#elif defined(__GNUC__)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wnull-dereference"
-#pragma GCC diagnostic ignored "-Wuseless-cast"
-#pragma GCC diagnostic ignored "-Wold-style-cast"
-#endif
-
-#include <range/v3/algorithm/contains.hpp>
-
-#if defined(__clang__)
-#pragma clang diagnostic pop
-#elif defined(__GNUC__)
-#pragma GCC diagnostic pop
-#endif
-
 namespace fs = std::filesystem;
 
 namespace {
 
 // NOLINTNEXTLINE
 static constexpr std::string_view DOC_ENDPOINT = "https://www.kernel.org/doc/html/latest/admin-guide/sysctl";
-// NOLINTNEXTLINE
-static constexpr std::array<std::string_view, 3> DEPRECATED{
-    "base_reachable_time",
-    "retrans_time",
-    ""};
 
 constexpr std::string_view get_appendix_if_available(std::string_view entry) noexcept {
     if (entry.starts_with("net/ipv4")) {
@@ -79,62 +58,218 @@ constexpr std::string_view get_category(std::string_view entry) noexcept {
     return entry.substr(0, entry.find_first_of('/'));
 }
 
+auto read_option_value(const char* file_path) noexcept -> std::optional<std::string> {
+    std::ifstream file_stream{file_path};
+    if (!file_stream.is_open()) {
+        return std::nullopt;
+    }
+
+    std::string file_content{};
+    if (!std::getline(file_stream, file_content)) {
+        fmt::print(stderr, "Failed to read := '{}'\n", file_path);
+        return std::nullopt;
+    }
+    utils::replace_all(file_content, "\t", " ");
+    return file_content;
+}
+
+auto make_option(const char* full_path, std::string_view file_path) noexcept -> std::optional<SysctlOption> {
+    // Generate doc link.
+    auto&& doc_link = fmt::format("{}/{}.html{}", DOC_ENDPOINT, get_category(file_path), get_appendix_if_available(file_path));
+
+    // Parse option value.
+    // Skip if failed to open file descriptor, or to read it.
+    auto&& option_value = read_option_value(full_path);
+    if (!option_value) {
+        return std::nullopt;
+    }
+
+    std::string option_name{file_path};
+    SysctlOption::normalize_name(option_name);
+
+    return SysctlOption{std::string{file_path}, std::move(option_name), std::move(*option_value), std::move(doc_link)};
+}
+
 }  // namespace
 
 std::vector<SysctlOption> SysctlOption::get_options() noexcept {
+    return get_options(ScanRules::default_rules());
+}
+
+std::vector<SysctlOption> SysctlOption::get_options(const ScanRules& rules, std::stop_token stoken) noexcept {
     std::vector<SysctlOption> options{};
 
-    for (const auto& dir_entry : fs::recursive_directory_iterator{PROC_PATH}) {
-        if (fs::is_directory(dir_entry)) {
-            // Skip directories
+    const auto& process_entry = [&](const fs::directory_entry& dir_entry, std::string_view file_path) {
+        if (rules.is_excluded(file_path)) {
+            return;
+        }
+        if (auto&& option = make_option(dir_entry.path().c_str(), file_path); option) {
+            options.emplace_back(std::move(*option));
+        }
+    };
+
+    for (auto&& scan_root : rules.get_scan_roots()) {
+        /* clang-format off */
+        if (stoken.stop_requested()) { break; }
+        /* clang-format on */
+        const auto& root_path = fs::path{PROC_PATH} / scan_root;
+
+        std::error_code err{};
+        const fs::directory_entry root_entry{root_path, err};
+        if (err || !root_entry.exists()) {
+            fmt::print(stderr, "Skipping missing subtree := '{}'\n", root_path.c_str());
+            continue;
+        }
+        // Scope may point to the single option.
+        if (!root_entry.is_directory()) {
+            process_entry(root_entry, scan_root);
             continue;
         }
 
-        // Remove proc path, to leave just the option path,
-        // within the proc directory.
+        for (auto it = fs::recursive_directory_iterator{root_path}; it != fs::recursive_directory_iterator{}; ++it) {
+            // Remove proc path, to leave just the option path,
+            // within the proc directory.
+            std::string_view file_path = it->path().c_str();
+            if (file_path.starts_with(PROC_PATH)) {
+                file_path.remove_prefix(PROC_PATH.size());
+            }
+
+            if (it->is_directory()) {
+                // Superseded scan gives the pool thread back.
+                if (stoken.stop_requested()) {
+                    return options;
+                }
+                // Prune excluded subtrees, before descending into them.
+                if (!rules.should_descend(file_path)) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+
+            process_entry(*it, file_path);
+        }
+    }
+
+    return options;
+}
+
+SysctlDirectory SysctlOption::list_directory(std::string_view dir_path, const ScanRules& rules, std::stop_token stoken) noexcept {
+    SysctlDirectory listing{};
+
+    std::error_code err{};
+    for (const auto& dir_entry : fs::directory_iterator{fs::path{PROC_PATH} / dir_path, err}) {
+        /* clang-format off */
+        if (stoken.stop_requested()) { break; }
+        /* clang-format on */
         std::string_view file_path = dir_entry.path().c_str();
         if (file_path.starts_with(PROC_PATH)) {
             file_path.remove_prefix(PROC_PATH.size());
         }
 
-        // Skip `debug` and `dev`.
-        if (file_path.starts_with("debug") || file_path.starts_with("dev")) {
+        if (dir_entry.is_directory()) {
+            if (rules.should_descend(file_path)) {
+                listing.subdirs.emplace_back(file_path);
+            }
             continue;
         }
-
-        // Skip deprecated.
-        if (ranges::contains(DEPRECATED, dir_entry.path().filename())) {
+        if (rules.is_excluded(file_path)) {
             continue;
         }
+        if (auto&& option = make_option(dir_entry.path().c_str(), file_path); option) {
+            listing.options.emplace_back(std::move(*option));
+        }
+    }
+    if (err) {
+        fmt::print(stderr, "Failed to list := '{}{}'\n", PROC_PATH, dir_path);
+    }
 
-        // Generate doc link.
-        auto&& doc_link = fmt::format("{}/{}.html{}", DOC_ENDPOINT, get_category(file_path), get_appendix_if_available(file_path));
+    std::sort(listing.subdirs.begin(), listing.subdirs.end());
+    std::sort(listing.options.begin(), listing.options.end(), [](auto&& lhs, auto&& rhs) { return lhs.get_name() < rhs.get_name(); });
+    return listing;
+}
 
-        // Parse option value.
-        std::string&& option_value{"nil"};
-        std::string file_content{};
+void SysctlOption::normalize_name(std::string& name) noexcept {
+    if (name.starts_with(PROC_PATH)) {
+        name.erase(0, PROC_PATH.size());
+    }
 
-        // Skip if failed to open file descriptor.
-        std::ifstream file_stream{dir_entry.path().c_str()};
-        if (!file_stream.is_open()) {
-            continue;
-        }
-        // auto&& file_content = utils::read_whole_file(dir_entry.path().c_str());
-        // if (file_content.empty()) {
-        if (!std::getline(file_stream, file_content)) {
-            fmt::print(stderr, "Failed to read := '{}'\n", dir_entry.path().c_str());
-            continue;
+    // Option name is path, with path delimeters('/') replaced with '.'.
+    utils::replace_all(name, "/", ".");
+}
+
+void SysctlOption::normalize_path(std::string& name) noexcept {
+    if (name.starts_with(PROC_PATH)) {
+        name.erase(0, PROC_PATH.size());
+    }
+    if (name.find('/') == std::string::npos) {
+        utils::replace_all(name, ".", "/");
+    }
+}
+
+bool SysctlOption::is_option_path(std::string_view raw_path) noexcept {
+    /* clang-format off */
+    if (raw_path.empty() || raw_path.starts_with('/')) { return false; }
+    /* clang-format on */
+
+    // Every component must name an entry, `..` would climb out of PROC_PATH.
+    for (std::size_t begin{}; begin <= raw_path.size();) {
+        const auto end       = std::min(raw_path.find('/', begin), raw_path.size());
+        const auto component = raw_path.substr(begin, end - begin);
+        if (component.empty() || component == "." || component == "..") {
+            return false;
         }
-        option_value = std::move(file_content);
-        utils::replace_all(option_value, "\t", " ");
+        begin = end + 1;
+    }
+
+    // Symlinks still might lead somewhere else.
+    std::error_code err_code{};
+    const auto& file_path = fs::canonical(fmt::format("{}{}", PROC_PATH, raw_path), err_code);
+    /* clang-format off */
+    if (err_code || !file_path.native().starts_with(PROC_PATH)) { return false; }
+    /* clang-format on */
+    return fs::is_regular_file(file_path, err_code);
+}
 
-        // Option name is path, with path delimeters('/') replaced with '.'.
-        std::string option_name{file_path};
-        utils::replace_all(option_name, "/", ".");
+bool SysctlOption::parse_conf_line(std::string_view line, std::string_view& key, std::string_view& value) noexcept {
+    constexpr std::string_view whitespace = " \t\r\n";
 
-        auto option_obj = SysctlOption{std::string{file_path}, std::move(option_name), std::move(option_value), std::move(doc_link)};
-        options.emplace_back(std::move(option_obj));
+    line.remove_prefix(std::min(line.find_first_not_of(whitespace), line.size()));
+    if (line.empty() || line.starts_with('#') || line.starts_with(';')) {
+        return false;
     }
 
-    return options;
+    const auto delim_pos = line.find('=');
+    if (delim_pos == std::string_view::npos) {
+        return false;
+    }
+    key   = line.substr(0, delim_pos);
+    value = line.substr(delim_pos + 1);
+
+    key.remove_suffix(key.size() - (key.find_last_not_of(whitespace) + 1));
+    value.remove_prefix(std::min(value.find_first_not_of(whitespace), value.size()));
+    return !key.empty();
+}
+
+std::string SysctlOption::normalize_value(std::string_view value) noexcept {
+    constexpr std::string_view whitespace = " \t\r\n";
+
+    std::string result{};
+    result.reserve(value.size());
+    while (true) {
+        value.remove_prefix(std::min(value.find_first_not_of(whitespace), value.size()));
+        if (value.empty()) {
+            return result;
+        }
+        if (!result.empty()) {
+            result += ' ';
+        }
+        const auto token = value.substr(0, value.find_first_of(whitespace));
+        result += token;
+        value.remove_prefix(token.size());
+    }
+}
+
+std::optional<std::string> SysctlOption::read_value(std::string_view raw_path) noexcept {
+    const auto& file_path = fmt::format("{}{}", PROC_PATH, raw_path);
+    return read_option_value(file_path.c_str());
 }
@@ -19,10 +19,16 @@
 #ifndef SYSCTL_OPTION_HPP
 #define SYSCTL_OPTION_HPP
 
+#include "scan_rules.hpp"
+
+#include <optional>     // for optional
+#include <stop_token>   // for stop_token
 #include <string>       // for string
 #include <string_view>  // for string_view
 #include <vector>       // for vector
 
+struct SysctlDirectory;
+
 class SysctlOption {
  public:
     consteval SysctlOption() = default;
@@ -43,10 +49,43 @@ class SysctlOption {
 
     inline std::string_view get_doc() const noexcept
     { return m_doc.c_str(); }
+
+    inline void set_value(std::string&& value) noexcept
+    { m_value = std::move(value); }
     /* clang-format on */
 
     static std::vector<SysctlOption> get_options() noexcept;
 
+    // Scans only options allowed by `rules`, excluded directories are not descended into.
+    // Stops at the next directory once `stoken` is triggered, returning options found so far.
+    static std::vector<SysctlOption> get_options(const ScanRules& rules, std::stop_token stoken = {}) noexcept;
+
+    // Lists single directory without descending into subdirectories.
+    // `dir_path` is relative to PROC_PATH, empty one stands for PROC_PATH itself.
+    // Stops early once `stoken` is triggered, the listing is incomplete then.
+    static SysctlDirectory list_directory(std::string_view dir_path, const ScanRules& rules, std::stop_token stoken = {}) noexcept;
+
+    // Converts option path (e.g `net/ipv4/tcp_mem`, optionally prefixed with PROC_PATH)
+    // into the option name (e.g `net.ipv4.tcp_mem`).
+    static void normalize_name(std::string& name) noexcept;
+
+    // Converts option name (e.g `net.ipv4.tcp_mem`) into the path relative to PROC_PATH
+    // (e.g `net/ipv4/tcp_mem`). Slashed path is taken as is, interface names may contain dots.
+    static void normalize_path(std::string& name) noexcept;
+
+    // Checks that path relative to PROC_PATH names an option file, and doesn't lead outside of PROC_PATH.
+    static bool is_option_path(std::string_view raw_path) noexcept;
+
+    // Parses sysctl.conf `key = value` line. Returns false for empty lines and comments.
+    static bool parse_conf_line(std::string_view line, std::string_view& key, std::string_view& value) noexcept;
+
+    // Collapses whitespace, so tab separated fields compare equal to space separated ones.
+    static std::string normalize_value(std::string_view value) noexcept;
+
+    // Reads current value of the option, by its path relative to PROC_PATH.
+    // Returns nothing if the option cannot be opened or read.
+    static std::optional<std::string> read_value(std::string_view raw_path) noexcept;
+
  private:
     std::string m_raw{};
     std::string m_name{};
@@ -54,4 +93,11 @@ class SysctlOption {
     std::string m_doc{};
 };
 
+struct SysctlDirectory {
+    // Paths relative to PROC_PATH, sorted.
+    std::vector<std::string> subdirs{};
+    // Sorted by name.
+    std::vector<SysctlOption> options{};
+};
+
 #endif  // SYSCTL_OPTION_HPP
@@ -0,0 +1,111 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include "task_scheduler.hpp"
+
+#include <algorithm>  // for clamp, find
+
+#include <fmt/core.h>
+
+std::size_t TaskScheduler::default_thread_count() noexcept {
+    // Leave a room for the long running tasks (e.g waiting for pkexec),
+    // while keeping the pool small.
+    return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 2, 4);
+}
+
+TaskScheduler::TaskScheduler(std::size_t thread_count) noexcept {
+    m_workers.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        m_workers.emplace_back([this](std::stop_token stoken) { worker_loop(std::move(stoken)); });
+    }
+}
+
+TaskScheduler::~TaskScheduler() noexcept {
+    shutdown();
+}
+
+std::stop_source TaskScheduler::submit(TaskPriority priority, task_t&& task) noexcept {
+    std::stop_source stop{};
+    {
+        const std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_shutdown) {
+            stop.request_stop();
+            return stop;
+        }
+        m_queue.push(Entry{.priority = priority, .sequence = m_sequence++, .stop = stop, .func = std::move(task)});
+    }
+    m_cv.notify_one();
+    return stop;
+}
+
+void TaskScheduler::cancel_all() noexcept {
+    const std::lock_guard<std::mutex> guard(m_mutex);
+    while (!m_queue.empty()) {
+        auto entry = m_queue.top();
+        entry.stop.request_stop();
+        m_queue.pop();
+    }
+    for (auto&& stop : m_running) {
+        stop.request_stop();
+    }
+}
+
+void TaskScheduler::shutdown() noexcept {
+    {
+        const std::lock_guard<std::mutex> guard(m_mutex);
+        m_shutdown = true;
+    }
+    cancel_all();
+
+    for (auto&& worker : m_workers) {
+        worker.request_stop();
+    }
+    // Joins workers.
+    m_workers.clear();
+}
+
+void TaskScheduler::worker_loop(std::stop_token stoken) noexcept {
+    while (!stoken.stop_requested()) {
+        Entry entry{};
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_cv.wait(lock, stoken, [this] { return !m_queue.empty(); })) {
+                return;
+            }
+            entry = m_queue.top();
+            m_queue.pop();
+
+            // Task was cancelled before it started.
+            if (entry.stop.stop_requested()) {
+                continue;
+            }
+            m_running.push_back(entry.stop);
+        }
+
+        try {
+            entry.func(entry.stop.get_token());
+        } catch (const std::exception& ex) {
+            fmt::print(stderr, "Task failed := '{}'\n", ex.what());
+        }
+
+        const std::lock_guard<std::mutex> guard(m_mutex);
+        if (auto it = std::find(m_running.begin(), m_running.end(), entry.stop); it != m_running.end()) {
+            m_running.erase(it);
+        }
+    }
+}
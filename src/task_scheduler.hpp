@@ -0,0 +1,94 @@
+// Copyright (C) 2022-2024 Vladislav Nepogodin
+//
+// This file is part of CachyOS sysctl manager.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <condition_variable>  // for condition_variable_any
+#include <cstdint>             // for uint8_t, uint64_t
+#include <functional>          // for function
+#include <mutex>               // for mutex
+#include <queue>               // for priority_queue
+#include <stop_token>          // for stop_source, stop_token
+#include <thread>              // for jthread
+#include <vector>              // for vector
+
+enum class TaskPriority : std::uint8_t {
+    Background,
+    Normal,
+    Interactive,
+};
+
+// Bounded thread pool, which runs tasks in order of their priority.
+//
+// Every task receives its own stop token, which is triggered when the task is
+// cancelled through the stop source returned by `submit`, or when the scheduler
+// shuts down. Tasks are expected to check it between units of work.
+class TaskScheduler final {
+ public:
+    using task_t = std::function<void(std::stop_token)>;
+
+    explicit TaskScheduler(std::size_t thread_count = default_thread_count()) noexcept;
+    ~TaskScheduler() noexcept;
+
+    TaskScheduler(const TaskScheduler&)            = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Queues task for execution. Returned stop source can be used to cancel it.
+    std::stop_source submit(TaskPriority priority, task_t&& task) noexcept;
+
+    // Cancels every queued and running task.
+    void cancel_all() noexcept;
+
+    // Cancels every task and waits for running ones to finish.
+    // Tasks submitted afterwards are dropped.
+    void shutdown() noexcept;
+
+    static std::size_t default_thread_count() noexcept;
+
+ private:
+    struct Entry {
+        TaskPriority priority{};
+        std::uint64_t sequence{};
+        std::stop_source stop{};
+        task_t func{};
+    };
+
+    struct EntryCompare {
+        bool operator()(const Entry& lhs, const Entry& rhs) const noexcept {
+            if (lhs.priority != rhs.priority) {
+                return lhs.priority < rhs.priority;
+            }
+            // FIFO within same priority.
+            return lhs.sequence > rhs.sequence;
+        }
+    };
+
+    void worker_loop(std::stop_token stoken) noexcept;
+
+    std::mutex m_mutex{};
+    std::condition_variable_any m_cv{};
+    std::priority_queue<Entry, std::vector<Entry>, EntryCompare> m_queue{};
+    std::vector<std::stop_source> m_running{};
+    std::uint64_t m_sequence{};
+    bool m_shutdown{};
+
+    std::vector<std::jthread> m_workers{};
+};
+
+#endif  // TASK_SCHEDULER_HPP